@@ -0,0 +1,55 @@
+#ifndef VB_I2C_BUS_CAPTURE
+#define VB_I2C_BUS_CAPTURE
+
+#include <stdint.h>
+
+/*
+Enregistrement du trafic sur le bus, et rejeu.
+
+Chaque transaction vue par VbI2C (Client ou Serveur) donne un enregistrement:
+    - 8 bytes d'en-tête (CAPTURE_HEADER_SIZE)
+    - puis uniquement les bytes transférés (length)
+
+Un fichier de capture est la suite de ces enregistrements, dans l'ordre. Tous les champs sont little-endian.
+Le sens est toujours vu du maître: une écriture du serveur vers un client est un CAPTURE_WRITE des deux côtés.
+Un paquet poussé par un client vers le serveur (VbI2C::receiveEvent() du serveur) va dans le sens d'une lecture: CAPTURE_READ, à l'adresse du client.
+
+Le rejeu (VbI2C::replay) relit une capture à la place du bus, à la vitesse d'origine ou au maximum.
+Les bytes que VbI2C aurait envoyés sont comparés à ceux de la capture: les différences sont comptées dans mismatches.
+Côté serveur, les écritures de la capture sont des sorties: celles qu'il ne refait pas (paquets envoyés par l'application
+pendant la capture) sont sautées et comptées dans skipped, et chaque lecture se recale sur la prochaine lecture du même client.
+*/
+
+enum CAPTURE_DIRECTION : uint8_t
+{
+    CAPTURE_WRITE = 0x0, // Maître -> esclave
+    CAPTURE_READ = 0x1,  // Esclave -> maître
+};
+
+#define CAPTURE_HEADER_SIZE 8
+
+typedef struct
+{
+    uint32_t timestamp; // micros() au moment de la transaction, sur la machine qui a capturé. Sous Linux, à l'envoi du lot qui la contient.
+    uint8_t address;    // Adresse I2C du client
+    uint8_t direction;  // CAPTURE_DIRECTION
+    uint8_t length;     // Nombre de bytes transférés
+    uint8_t result;     // 0 si la transaction a réussi. Sinon le code de Wire.endTransmission(), ou 1 pour une lecture incomplète.
+    uint8_t data[32];   // Seuls les length premiers bytes sont enregistrés
+} CAPTURE_RECORD, *CAPTURE_RECORD_T;
+
+// Reçoit chaque enregistrement (CAPTURE_HEADER_SIZE + length bytes). Côté client, appelé sous interruption: doit être rapide.
+typedef void (*CaptureSink)(const uint8_t *, uint8_t);
+
+// Remplit l'enregistrement suivant de la capture. Renvoi false à la fin.
+typedef bool (*ReplaySource)(CAPTURE_RECORD_T);
+
+typedef struct
+{
+    uint32_t records;    // Enregistrements rejoués
+    uint32_t mismatches; // Transactions différentes de la capture (adresse, sens ou contenu)
+    uint32_t skipped;    // Transactions de la capture que VbI2C n'a pas refaites
+    uint32_t elapsed;    // Durée du rejeu en microsecondes
+} REPLAY_RESULT;
+
+#endif
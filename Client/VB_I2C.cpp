@@ -70,14 +70,29 @@ SERVER_DATA_T VbI2C::getData()
     }
 }
 
-bool VbI2C::sendData(CLIENT_DATA_T data)
+int VbI2C::acquireSlot(CLIENT_DATA_TYPE dataType)
 {
-    noInterrupts();
+    // A appeler interruptions désactivées.
+    // Si le type est remplacé sur place, on cherche un paquet du même type qui n'a pas encore été envoyé
+    if (dataType < 32 && (this->coalescedTypes >> dataType) & 1)
+    {
+        for (int i = 0; i < this->clientDataAvailable; i++)
+        {
+            if (this->clientDataQueue[i]->dataType == dataType)
+            {
+#ifdef DEBUG
+                Serial.print("Coalescing data, index: ");
+                Serial.println(i);
+#endif
+                return i;
+            }
+        }
+    }
+
     int index = this->clientDataAvailable;
-    if (index > CLIENT_DATA_ARRAY_SIZE)
+    if (index >= CLIENT_DATA_ARRAY_SIZE)
     {
-        Serial.println("TOO MUCH IN QUEUE");
-        return false;
+        return -1;
     }
 
 #ifdef DEBUG
@@ -87,22 +102,87 @@ bool VbI2C::sendData(CLIENT_DATA_T data)
     Serial.println((int)this->clientDataQueue[index], 16);
 #endif
 
+    this->clientDataAvailable++;
+    return index;
+}
+
+bool VbI2C::sendData(CLIENT_DATA_T data)
+{
+    noInterrupts();
+    int index = this->acquireSlot(data->dataType);
+    if (index < 0)
+    {
+        interrupts();
+        Serial.println("TOO MUCH IN QUEUE");
+        return false;
+    }
+
     // On ajoute une donnée à la file.
     // J'utilise memcpy pour garder toujours les mêmes emplacements mémoires...
     memcpy(this->clientDataQueue[index], data, 32);
 
-    // On redéfinie le clientId.
+    // On redéfinie le clientId, et on horodate le paquet si besoin pour que le serveur mesure sa latence.
     this->clientDataQueue[index]->clientId = this->clientId;
+    this->stamp(this->clientDataQueue[index]);
 
 #ifdef DEBUG
     Serial.print("Packet ID: ");
     Serial.println(this->clientDataQueue[index]->dataType);
 #endif
     interrupts();
-    this->clientDataAvailable++;
     return true;
 }
 
+void VbI2C::setCoalescing(CLIENT_DATA_TYPE dataType, bool enabled)
+{
+    // Chaque réponse RPC est attendue par le serveur: on ne les remplace jamais.
+    if (dataType >= 32 || dataType == CLIENT_DATA_TYPE::RPC_RESPONSE)
+    {
+        return;
+    }
+    if (enabled)
+    {
+        this->coalescedTypes |= ((uint32_t)1 << dataType);
+    }
+    else
+    {
+        this->coalescedTypes &= ~((uint32_t)1 << dataType);
+    }
+}
+
+void VbI2C::setTimestamping(CLIENT_DATA_TYPE dataType, bool enabled)
+{
+    if (dataType >= 32)
+    {
+        return;
+    }
+    if (enabled)
+    {
+        this->timestampedTypes |= ((uint32_t)1 << dataType);
+    }
+    else
+    {
+        this->timestampedTypes &= ~((uint32_t)1 << dataType);
+    }
+}
+
+bool VbI2C::isTimestamped(CLIENT_DATA_TYPE dataType)
+{
+    return dataType < 32 && (this->timestampedTypes >> dataType) & 1;
+}
+
+void VbI2C::stamp(CLIENT_DATA_T packet)
+{
+    // A appeler interruptions désactivées: receiveEvent() peut changer clockOffset.
+    if (!this->clockSynced || !this->isTimestamped(packet->dataType))
+    {
+        return;
+    }
+    uint32_t now = micros() + this->clockOffset;
+    memcpy(&packet->data[CLIENT_TIMESTAMP_OFFSET], &now, sizeof(now));
+    packet->clientId |= CLIENT_TIMESTAMP_FLAG;
+}
+
 void VbI2C::clearClientData()
 {
     for (size_t i = 0; i < CLIENT_DATA_ARRAY_SIZE; i++)
@@ -128,6 +208,20 @@ bool VbI2C::isSendingData()
     return this->clientSendingData;
 }
 
+uint32_t VbI2C::getSyncedTime()
+{
+    // clockOffset fait 4 bytes: sur AVR, receiveEvent() peut le modifier au milieu de la lecture
+    noInterrupts();
+    uint32_t syncedTime = micros() + this->clockOffset;
+    interrupts();
+    return syncedTime;
+}
+
+bool VbI2C::isClockSynced()
+{
+    return this->clockSynced;
+}
+
 void VbI2C::dump()
 {
     Serial.println("DUMPING VBi2C data.");
@@ -172,55 +266,82 @@ void VbI2C::receiveEvent()
     {
 
         // On transfère les bytes reçues dans un emplacement mémoire. On caste en uint8_t (Au final, ce sont des uint8_t)
+        // Les paquets déclarés avec VB_SCHEMA n'envoient que leurs bytes utiles, le reste est à 0.
         byte buff[32];
-        Wire.readBytes(buff, 32);
-
-        this->serverDataAvailable++;
-
-        memcpy(this->serverDataQueue[this->serverDataAvailable - 1], &buff, 32);
-
-        // Serial.print("Writing to: ");
-        // Serial.print("0x");
-        // Serial.println((int)this->serverDataQueue[this->serverDataAvailable - 1], HEX);
-
-        // Serial.print("IDX: ");
-        // Serial.println(this->serverDataAvailable);
+        memset(buff, 0, sizeof(buff));
+        int length = Wire.available();
+        if (length > 32)
+        {
+            length = 32;
+        }
+        Wire.readBytes(buff, length);
+        this->capture(CAPTURE_WRITE, buff, length);
 
-        // On récupère le pointeur pour vérifier les données
-        SERVER_DATA_T receivedData = this->serverDataQueue[this->serverDataAvailable - 1];
+        this->handleServerPacket(buff);
+    }
+}
 
+void VbI2C::handleServerPacket(const uint8_t *buff)
+{
 #ifdef DEBUG
-        Serial.println("RECEIVED SERVER PACKET OVER WIRE");
-        Serial.print("Packet ID: ");
-        Serial.println(receivedData->dataType, HEX);
+    Serial.println("RECEIVED SERVER PACKET OVER WIRE");
+    Serial.print("Packet ID: ");
+    Serial.println(buff[0], HEX);
 #endif
 
-        if (receivedData->dataType == SERVER_DATA_TYPE::START_TX)
-        {
+    if (buff[0] == SERVER_DATA_TYPE::START_TX)
+    {
 
 #ifdef DEBUG
-            Serial.println("SERVER_DATA_TYPE::START_TX");
+        Serial.println("SERVER_DATA_TYPE::START_TX");
 #endif
-            this->clientSendingData = true;
-            this->serverDataAvailable--;
-        }
-        else if (receivedData->dataType == SERVER_DATA_TYPE::STOP_TX)
-        {
+        this->clientSendingData = true;
+    }
+    else if (buff[0] == SERVER_DATA_TYPE::STOP_TX)
+    {
 
 #ifdef DEBUG
-            Serial.println("SERVER_DATA_TYPE::STOP_TX");
+        Serial.println("SERVER_DATA_TYPE::STOP_TX");
+#endif
+        this->clientSendingData = false;
+    }
+    else if (buff[0] == SERVER_DATA_TYPE::TIME_SYNC)
+    {
+        // Le serveur compense déjà la durée de la transmission
+        uint32_t serverTime;
+        memcpy(&serverTime, &buff[1], sizeof(serverTime));
+        this->clockOffset = serverTime - micros();
+        this->clockSynced = true;
+#ifdef DEBUG
+        Serial.print("SERVER_DATA_TYPE::TIME_SYNC, offset: ");
+        Serial.println(this->clockOffset);
+#endif
+    }
+    else if (buff[0] == SERVER_DATA_TYPE::RPC_REQUEST && this->rpcHandler != NULL)
+    {
+        // On répond avant que le serveur ne vienne chercher nos paquets, dans le même tick()
+        uint8_t result[RPC_RESULT_SIZE];
+        memset(result, 0, sizeof(result));
+        uint8_t status = this->rpcHandler(buff[2], &buff[3], result);
+        this->queueResponse(buff[1], status, result, sizeof(result));
+#ifdef DEBUG
+        Serial.print("SERVER_DATA_TYPE::RPC_REQUEST, status: ");
+        Serial.println(status);
 #endif
-            this->clientSendingData = false;
-            this->serverDataAvailable--;
+    }
+    else
+    {
+        if (this->serverDataAvailable >= SERVER_DATA_ARRAY_SIZE)
+        {
+            // File pleine: le paquet est perdu
+            return;
         }
-        else
+        memcpy(this->serverDataQueue[this->serverDataAvailable++], buff, 32);
+
+        if (this->hasCallback)
         {
-            if (this->hasCallback)
-            {
-                this->userDataReceivedCallback();
-            }
+            this->userDataReceivedCallback();
         }
-        
     }
 }
 
@@ -238,7 +359,7 @@ void VbI2C::sendAvailablePacketsToServer()
     Serial.print("Available packets: ");
     Serial.println(this->clientDataAvailable);
 #endif
-    int sent = Wire.write((uint8_t *)&availablePacketsPacket, sizeof(CLIENT_DATA));
+    int sent = this->busWrite((uint8_t *)&availablePacketsPacket, sizeof(CLIENT_DATA));
 
 #ifdef DEBUG
     Serial.print("Sent: ");
@@ -255,7 +376,8 @@ void VbI2C::requestEvent()
     Serial.println("requestEvent()");
 #endif
 
-    if (!this->isSendingData())
+    // Si le serveur demande plus de paquets qu'annoncé, on lui renvoi le nombre de paquets disponibles
+    if (!this->isSendingData() || this->clientDataAvailable <= 0)
     {
         this->sendAvailablePacketsToServer();
     }
@@ -270,7 +392,7 @@ void VbI2C::requestEvent()
             Serial.print(' ');
         }
 #endif
-        Wire.write((uint8_t *)this->clientDataQueue[(this->clientDataAvailable - 1)], 32);
+        this->busWrite((uint8_t *)this->clientDataQueue[(this->clientDataAvailable - 1)], 32);
         this->clientDataAvailable--;
 #ifdef DEBUG
         Serial.println("Sent packet");
@@ -282,4 +404,141 @@ void VbI2C::setCallback(void (*user_func)())
 {
     this->userDataReceivedCallback = user_func;
     this->hasCallback = true;
-}
\ No newline at end of file
+}
+
+void VbI2C::setRpcHandler(uint8_t (*handler)(uint8_t, const uint8_t *, uint8_t *))
+{
+    noInterrupts();
+    this->rpcHandler = handler;
+    interrupts();
+}
+
+bool VbI2C::reply(uint8_t correlationId, uint8_t status, const uint8_t *result, uint8_t length)
+{
+    noInterrupts();
+    bool queued = this->queueResponse(correlationId, status, result, length);
+    interrupts();
+    return queued;
+}
+
+bool VbI2C::queueResponse(uint8_t correlationId, uint8_t status, const uint8_t *result, uint8_t length)
+{
+    int index = this->acquireSlot(CLIENT_DATA_TYPE::RPC_RESPONSE);
+    if (index < 0)
+    {
+        // Le serveur considérera la requête comme expirée
+        return false;
+    }
+    if (length > RPC_RESULT_SIZE)
+    {
+        length = RPC_RESULT_SIZE;
+    }
+
+    CLIENT_DATA_T packet = this->clientDataQueue[index];
+    packet->dataType = CLIENT_DATA_TYPE::RPC_RESPONSE;
+    packet->clientId = this->clientId;
+    memset(packet->data, 0, sizeof(packet->data));
+    packet->data[0] = correlationId;
+    packet->data[1] = status;
+    memcpy(&packet->data[2], result, length);
+    this->stamp(packet);
+    return true;
+}
+
+uint8_t VbI2C::busWrite(const uint8_t *data, uint8_t length)
+{
+    if (this->replaying)
+    {
+        // Rejeu: rien ne part sur le bus, on compare avec la capture. L'horodatage dépend du moment du rejeu, on l'ignore.
+        uint8_t compared = length;
+        if (length > offsetof(CLIENT_DATA, clientId) && (data[offsetof(CLIENT_DATA, clientId)] & CLIENT_TIMESTAMP_FLAG))
+        {
+            uint8_t stampOffset = offsetof(CLIENT_DATA, data) + CLIENT_TIMESTAMP_OFFSET;
+            compared = length < stampOffset ? length : stampOffset;
+        }
+        if (this->replayRecord.direction != CAPTURE_READ || this->replayRecord.length != length || memcmp(this->replayRecord.data, data, compared) != 0)
+        {
+            this->replayResult.mismatches++;
+        }
+        return length;
+    }
+
+    uint8_t sent = Wire.write(data, length);
+    this->capture(CAPTURE_READ, data, sent);
+    return sent;
+}
+
+void VbI2C::capture(uint8_t direction, const uint8_t *data, uint8_t length)
+{
+    if (this->captureSink == NULL || this->replaying)
+    {
+        return;
+    }
+
+    CAPTURE_RECORD record;
+    record.timestamp = micros();
+    record.address = this->clientId;
+    record.direction = direction;
+    record.length = length;
+    record.result = 0;
+    memcpy(record.data, data, length);
+    this->captureSink((uint8_t *)&record, CAPTURE_HEADER_SIZE + length);
+}
+
+void VbI2C::setCaptureSink(CaptureSink sink)
+{
+    noInterrupts();
+    this->captureSink = sink;
+    interrupts();
+}
+
+REPLAY_RESULT VbI2C::replay(ReplaySource source, bool realtime)
+{
+    memset(&this->replayResult, 0, sizeof(REPLAY_RESULT));
+    this->replaying = true;
+    uint32_t start = micros();
+    uint32_t firstTimestamp = 0;
+    bool first = true;
+
+    while (source(&this->replayRecord))
+    {
+        if (first)
+        {
+            firstTimestamp = this->replayRecord.timestamp;
+            first = false;
+        }
+
+        // Seules les transactions avec ce client sont rejouées
+        if (this->replayRecord.address != this->clientId)
+        {
+            continue;
+        }
+
+        // Vitesse d'origine: on attend le moment de la transaction dans la capture
+        if (realtime)
+        {
+            uint32_t target = this->replayRecord.timestamp - firstTimestamp;
+            while ((uint32_t)(micros() - start) < target)
+            {
+            }
+        }
+        this->replayResult.records++;
+
+        // Comme sur le bus, les handlers sont appelés interruptions désactivées
+        noInterrupts();
+        if (this->replayRecord.direction == CAPTURE_WRITE)
+        {
+            memset(this->replayRecord.data + this->replayRecord.length, 0, sizeof(this->replayRecord.data) - this->replayRecord.length);
+            this->handleServerPacket(this->replayRecord.data);
+        }
+        else
+        {
+            this->requestEvent();
+        }
+        interrupts();
+    }
+
+    this->replaying = false;
+    this->replayResult.elapsed = micros() - start;
+    return this->replayResult;
+}
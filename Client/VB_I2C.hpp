@@ -5,7 +5,10 @@
 #define SERVER_DATA_ARRAY_SIZE 8
 
 #include <stdint.h>
+#include <Arduino.h>
 #include "../PACKET_TYPES.hpp"
+#include "../MESSAGE_SCHEMA.hpp"
+#include "../BUS_CAPTURE.hpp"
 
 typedef struct // Données envoyées par le serveur au client
 {
@@ -17,7 +20,7 @@ typedef struct // Données à envoyer au serveur
 {
     enum CLIENT_DATA_TYPE dataType; // Type de paquet
     uint8_t clientId;
-    uint8_t data[30];               // Données, 31 bytes
+    uint8_t data[30];               // Données, 30 bytes. Les 4 derniers portent l'horodatage si clientId & CLIENT_TIMESTAMP_FLAG
 } CLIENT_DATA, *CLIENT_DATA_T;
 
 class VbI2C
@@ -31,11 +34,32 @@ public:
     // Ajoute des infos pour la prochaine fois que le serveur demande des infos
     bool sendData(CLIENT_DATA_T);
 
+    // Pareil, pour un message déclaré avec VB_SCHEMA. Seuls les champs déclarés sont copiés.
+    template <typename Message>
+    bool sendMessage(const Message &);
+
+    // Retire le prochain paquet de la file et appelle le handler typé correspondant. Cf MESSAGE_SCHEMA.hpp
+    // Renvoi false si la file est vide ou si aucun handler ne correspond: dans ce cas le paquet reste disponible pour getData().
+    template <typename... Handlers>
+    bool dispatch(Handlers...);
+
+    // Si activé pour un type, un nouveau paquet de ce type remplace sur place celui encore en attente d'envoi au lieu d'être ajouté à la file.
+    // Utile pour les paquets d'état (progression...) dont seule la dernière valeur compte. Types 0 à 31 uniquement.
+    void setCoalescing(CLIENT_DATA_TYPE, bool);
+
+    // Si activé pour un type, ses paquets sont horodatés à la mise en file pour que le serveur mesure leur latence (une fois l'horloge synchronisée).
+    // L'heure occupe data[26] à data[29]: sendData() les écrase, sendMessage() refuse les messages de plus de 26 bytes. Types 0 à 31 uniquement.
+    void setTimestamping(CLIENT_DATA_TYPE, bool);
+
     void clearClientData(); // Remet le compteur de données à envoyer à 0;
     void clearServerData(); // Remet le compteur de données reçues à 0;
 
     bool isSendingData(); // Renvoi true si clientSendingData == true
 
+    // Horloge synchronisée sur celle du serveur (paquets TIME_SYNC), en microsecondes. Sert à horodater les paquets envoyés. Cf setTimestamping()
+    uint32_t getSyncedTime(); // Réactive les interruptions: ne pas appeler depuis une section noInterrupts()
+    bool isClockSynced(); // Renvoi true dès le premier TIME_SYNC reçu
+
     // NB, les deux méthodes ci dessous doivent être proxy. Cf I2C.ino (exemple)
     void receiveEvent(); // Handler pour les paquets.
     void requestEvent(); // Handler pour les requêtes de données du serveur.
@@ -43,9 +67,23 @@ public:
     // L'utilisateur peut définir un callback qui sera appelé à chaque fois que le serveur envoi un paquet.
     void setCallback(void (*)());
 
+    // Handler des RPC_REQUEST: (méthode, arguments, résultat à remplir) -> RPC_STATUS. Appelé sous interruption.
+    // La réponse est mise en file tout de suite: le serveur la récupère au même tick().
+    // Sans handler, les RPC_REQUEST arrivent dans la file comme les autres paquets et l'utilisateur répond avec reply().
+    void setRpcHandler(uint8_t (*)(uint8_t, const uint8_t *, uint8_t *));
+
+    // Répond à un RPC_REQUEST (ID de corrélation, RPC_STATUS, résultat, taille du résultat <= RPC_RESULT_SIZE)
+    bool reply(uint8_t, uint8_t, const uint8_t *, uint8_t);
+
     // Sert à vérifier le contenu de la mémoire
     void dump(); 
 
+    // Chaque transaction sur le bus est enregistrée et passée à la fonction, sous interruption. NULL pour arrêter. Cf BUS_CAPTURE.hpp
+    void setCaptureSink(CaptureSink);
+
+    // Rejoue les transactions de la capture adressées à ce client, à la place du bus. realtime: vitesse d'origine, sinon au maximum.
+    REPLAY_RESULT replay(ReplaySource, bool);
+
 private:
     SERVER_DATA_T serverDataQueue[SERVER_DATA_ARRAY_SIZE]; // Array de pointeurs vers les données du serveur en attente d'être lues
     CLIENT_DATA_T clientDataQueue[CLIENT_DATA_ARRAY_SIZE]; // Array de pointeurs vers les données du client en attente d'être envoyées
@@ -55,14 +93,88 @@ private:
 
     bool clientSendingData = false; // Défini par les paquets START_TX / STOP_TX.
 
+    uint32_t coalescedTypes = 0; // Un bit par type de paquet remplacé sur place. Cf setCoalescing()
+
+    uint32_t timestampedTypes = 0; // Un bit par type de paquet horodaté. Cf setTimestamping()
+    uint32_t clockOffset = 0; // Horloge du serveur - micros()
+    bool clockSynced = false;
+
     bool hasCallback = false;
     void (*userDataReceivedCallback)();
 
+    uint8_t (*rpcHandler)(uint8_t, const uint8_t *, uint8_t *) = NULL;
+
     uint8_t clientId = 0;
 
+    CaptureSink captureSink = NULL;
+
+    bool replaying = false;       // Pendant un rejeu, le bus n'est plus utilisé.
+    CAPTURE_RECORD replayRecord;  // Transaction en cours de rejeu
+    REPLAY_RESULT replayResult;
+
     void sendAvailablePacketsToServer();
+    void handleServerPacket(const uint8_t *); // Traite un paquet du serveur (32 bytes)
+    bool queueResponse(uint8_t, uint8_t, const uint8_t *, uint8_t); // A appeler interruptions désactivées
+
+    // Seul point d'écriture sur le bus. Renvoi le nombre de bytes écrits. Cf BUS_CAPTURE.hpp
+    uint8_t busWrite(const uint8_t *, uint8_t);
+    void capture(uint8_t, const uint8_t *, uint8_t);
+    int acquireSlot(CLIENT_DATA_TYPE); // Index de l'emplacement où écrire le prochain paquet, -1 si la file est pleine.
+    bool isTimestamped(CLIENT_DATA_TYPE);
+    void stamp(CLIENT_DATA_T); // Horodate le paquet si son type le demande. A appeler interruptions désactivées
 };
 
+template <typename Message>
+bool VbI2C::sendMessage(const Message &message)
+{
+    typedef VbSchemaOf<Message> Schema;
+    static_assert(VbSameType<typename Schema::DataType, CLIENT_DATA_TYPE>::value, "sendMessage: not a client message");
+
+    // Le message et l'horodatage ne doivent pas se chevaucher
+    if (Schema::size > CLIENT_TIMESTAMP_OFFSET && this->isTimestamped(Schema::dataType))
+    {
+        return false;
+    }
+
+    noInterrupts();
+    int index = this->acquireSlot(Schema::dataType);
+    if (index < 0)
+    {
+        interrupts();
+        return false;
+    }
+
+    CLIENT_DATA_T packet = this->clientDataQueue[index];
+    packet->dataType = Schema::dataType;
+    packet->clientId = this->clientId;
+    Schema::encode(message, packet->data);
+    memset(packet->data + Schema::size, 0, sizeof(packet->data) - Schema::size);
+    this->stamp(packet);
+    interrupts();
+    return true;
+}
+
+template <typename... Handlers>
+bool VbI2C::dispatch(Handlers... handlers)
+{
+    // On ne retire le paquet que si un handler le prend. Interruptions désactivées: receiveEvent() ne doit pas changer le haut de la file entre les deux.
+    // Une fois retiré, son emplacement est de nouveau libre pour receiveEvent(): on le copie avant de réactiver les interruptions.
+    noInterrupts();
+    SERVER_DATA packet;
+    bool handled = this->serverDataAvailable > 0 && vbHandles(this->serverDataQueue[this->serverDataAvailable - 1], handlers...);
+    if (handled)
+    {
+        memcpy(&packet, this->getData(), sizeof(SERVER_DATA));
+    }
+    interrupts();
+
+    if (!handled)
+    {
+        return false;
+    }
+    return vbDispatch(&packet, handlers...);
+}
+
 #endif
 
 /*
@@ -72,8 +184,11 @@ Ici, je stock les messages en mémoire (maximum 16 messages) en attendant l'envo
 
 Pour envoyer le serveur execute pour chaque client une séquence spécifique:
 
+    Serveur =(Paquets en attente pour ce client, sans STOP)=> Client
     Serveur =(Demande d'information avec .requestFrom())=> Client
     Serveur <=(Renvoi le nombre n de données prêtes à être envoyées)= Client
+
+    Si n > 0 (sinon la séquence s'arrête là):
     Serveur =(Envoi un paquet de type START_TX)=> Client
 
     Pour chaque n de 0 à 1:
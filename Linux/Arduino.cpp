@@ -0,0 +1,73 @@
+#include "Arduino.h"
+#include <stdio.h>
+#include <time.h>
+
+LinuxSerial Serial;
+
+void LinuxSerial::print(const char *value)
+{
+    fputs(value, stdout);
+}
+
+void LinuxSerial::print(char value)
+{
+    fputc(value, stdout);
+}
+
+void LinuxSerial::print(long value, int base)
+{
+    if (base == HEX)
+    {
+        printf("%lX", (unsigned long)value);
+    }
+    else
+    {
+        printf("%ld", value);
+    }
+}
+
+void LinuxSerial::print(unsigned long value, int base)
+{
+    printf(base == HEX ? "%lX" : "%lu", value);
+}
+
+void LinuxSerial::println()
+{
+    fputc('\n', stdout);
+}
+
+static uint64_t monotonicMicros()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Comme sur Arduino, le temps part du démarrage du programme et déborde (Environ 70 minutes pour micros()).
+static const uint64_t startMicros = monotonicMicros();
+
+unsigned long millis()
+{
+    return (unsigned long)((monotonicMicros() - startMicros) / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)(uint32_t)(monotonicMicros() - startMicros);
+}
+
+void delay(unsigned long ms)
+{
+    struct timespec duration;
+    duration.tv_sec = ms / 1000;
+    duration.tv_nsec = (ms % 1000) * 1000000;
+    nanosleep(&duration, NULL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    struct timespec duration;
+    duration.tv_sec = us / 1000000;
+    duration.tv_nsec = (us % 1000000) * 1000;
+    nanosleep(&duration, NULL);
+}
@@ -0,0 +1,56 @@
+#ifndef VB_I2C_LINUX_ARDUINO_H
+#define VB_I2C_LINUX_ARDUINO_H
+
+// Remplace Arduino.h pour compiler le serveur (Server/VB_I2C.cpp) sous Linux. Cf VB_I2C_LINUX.hpp
+// Seul ce dont la librairie a besoin est fourni.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+#define DEC 10
+#define HEX 16
+
+class LinuxSerial // Ecrit sur la sortie standard
+{
+public:
+    void print(const char *);
+    void print(char);
+    void print(long, int = DEC);
+    void print(unsigned long, int = DEC);
+    void print(int value, int base = DEC) { this->print((long)value, base); }
+    void print(unsigned int value, int base = DEC) { this->print((unsigned long)value, base); }
+    void print(unsigned char value, int base = DEC) { this->print((unsigned long)value, base); }
+
+    template <typename T>
+    void println(T value)
+    {
+        this->print(value);
+        this->println();
+    }
+
+    template <typename T>
+    void println(T value, int base)
+    {
+        this->print(value, base);
+        this->println();
+    }
+
+    void println();
+};
+
+extern LinuxSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+
+// Pas d'interruptions côté maître Linux: le bus n'est manipulé que par le thread de VbI2CLinux.
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+#endif
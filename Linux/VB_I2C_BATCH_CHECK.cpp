@@ -0,0 +1,176 @@
+// Vérifie, sans matériel, les lots que le serveur envoie au noyau. Cf VB_I2C_LINUX.hpp
+//
+//     g++ -std=c++11 -I Linux Server/VB_I2C.cpp Linux/Arduino.cpp Linux/Wire.cpp Linux/VB_I2C_BATCH_CHECK.cpp -o batch_check
+//     ./batch_check
+//
+// Wire.setTransport() remplace l'ioctl(I2C_RDWR) par des clients simulés qui suivent le protocole de Client/VB_I2C.cpp.
+// Chaque lot est noté "W10 R10 ..." (écriture / lecture, adresse en hexadécimal), puis comparé à la séquence attendue.
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include "../Server/VB_I2C.hpp"
+
+#define SIMULATED_CLIENTS 2
+#define SIMULATED_BATCHES 16
+
+typedef struct // Client simulé
+{
+    uint8_t address;
+    bool present;      // false: NACK sur l'adresse
+    bool sending;      // Entre START_TX et STOP_TX
+    uint8_t available; // Paquets à envoyer au serveur
+    uint8_t received;  // Paquets reçus du serveur (hors START_TX / STOP_TX)
+} SIMULATED_CLIENT;
+
+static SIMULATED_CLIENT simulatedClients[SIMULATED_CLIENTS];
+static char batches[SIMULATED_BATCHES][64];
+static int batchCount = 0;
+
+static SIMULATED_CLIENT *findClient(uint8_t address)
+{
+    for (int i = 0; i < SIMULATED_CLIENTS; i++)
+    {
+        if (simulatedClients[i].address == address)
+        {
+            return &simulatedClients[i];
+        }
+    }
+    return NULL;
+}
+
+static int simulatedTransport(struct i2c_msg *messages, int count)
+{
+    // On note la forme du lot
+    char *shape = batches[batchCount < SIMULATED_BATCHES ? batchCount++ : SIMULATED_BATCHES - 1];
+    shape[0] = '\0';
+    for (int i = 0; i < count; i++)
+    {
+        char message[8];
+        snprintf(message, sizeof(message), "%s%c%02x", i == 0 ? "" : " ", (messages[i].flags & I2C_M_RD) ? 'R' : 'W', messages[i].addr);
+        strcat(shape, message);
+    }
+
+    // Un lot ne vise qu'une adresse: un client absent fait échouer tout le lot
+    SIMULATED_CLIENT *client = findClient(messages[0].addr);
+    if (client == NULL || !client->present)
+    {
+        return -ENXIO;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t *buffer = messages[i].buf;
+        if (!(messages[i].flags & I2C_M_RD))
+        {
+            if (buffer[0] == SERVER_DATA_TYPE::START_TX)
+            {
+                client->sending = true;
+            }
+            else if (buffer[0] == SERVER_DATA_TYPE::STOP_TX)
+            {
+                client->sending = false;
+            }
+            else
+            {
+                client->received++;
+            }
+            continue;
+        }
+
+        // Comme VbI2C::requestEvent(): le nombre de paquets hors envoi, sinon le paquet suivant
+        CLIENT_DATA packet;
+        memset(&packet, 0, sizeof(CLIENT_DATA));
+        packet.clientId = client->address;
+        if (!client->sending || client->available == 0)
+        {
+            packet.dataType = CLIENT_DATA_TYPE::START_ACK;
+            packet.data[0] = client->available;
+        }
+        else
+        {
+            packet.dataType = CLIENT_DATA_TYPE::SUCCESS;
+            packet.data[0] = client->available--;
+        }
+        memcpy(buffer, &packet, messages[i].len);
+    }
+    return count;
+}
+
+static bool check(const char *name, const char *const *expected, int expectedCount)
+{
+    bool ok = batchCount == expectedCount;
+    for (int i = 0; ok && i < expectedCount; i++)
+    {
+        ok = strcmp(batches[i], expected[i]) == 0;
+    }
+
+    printf("%s %s:", ok ? "OK    " : "FAILED", name);
+    for (int i = 0; i < batchCount; i++)
+    {
+        printf(" [%s]", batches[i]);
+    }
+    printf("\n");
+    return ok;
+}
+
+static void reset(uint8_t available0x10, bool present0x10)
+{
+    SIMULATED_CLIENT clients[SIMULATED_CLIENTS] = {{0x10, present0x10, false, available0x10, 0}, {0x11, true, false, 0, 0}};
+    memcpy(simulatedClients, clients, sizeof(clients));
+    batchCount = 0;
+}
+
+static void queuePacket(VbI2C &server, uint8_t clientId)
+{
+    SERVER_DATA packet;
+    memset(&packet, 0, sizeof(SERVER_DATA));
+    packet.dataType = SERVER_DATA_TYPE::START;
+    packet.clientId = clientId;
+    server.sendData(&packet);
+}
+
+int main()
+{
+    Wire.setTransport(simulatedTransport);
+    bool ok = true;
+
+    VbI2C server;
+    server.registerClient(0x10);
+    server.registerClient(0x11);
+
+    // Les paquets d'un client partent avec sa demande d'informations: un transfert par client
+    reset(0, true);
+    queuePacket(server, 0x10);
+    server.tick();
+    const char *const queued[] = {"W10 R10", "R11"};
+    ok = check("1 queued packet, 2 clients", queued, 2) && ok;
+    ok = simulatedClients[0].received == 1 && ok;
+
+    // START_TX, les lectures et STOP_TX: un seul transfert
+    reset(2, true);
+    server.tick();
+    const char *const reads[] = {"R10", "W10 R10 R10 W10", "R11"};
+    ok = check("2 packets from 0x10", reads, 3) && ok;
+    int delivered = 0;
+    while (server.hasData())
+    {
+        server.getData();
+        delivered++;
+    }
+    ok = delivered == 2 && !simulatedClients[0].sending && ok;
+
+    // Un client absent ne fait pas perdre le trafic des autres
+    reset(0, false);
+    queuePacket(server, 0x10);
+    queuePacket(server, 0x11);
+    server.tick();
+    const char *const nack[] = {"W10 R10", "W11 R11"};
+    ok = check("0x10 absent", nack, 2) && ok;
+    ok = simulatedClients[1].received == 1 && ok;
+
+    printf(ok ? "All batch checks passed\n" : "Some batch checks FAILED\n");
+    return ok ? 0 : 1;
+}
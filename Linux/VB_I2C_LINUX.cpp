@@ -0,0 +1,163 @@
+#include "VB_I2C_LINUX.hpp"
+#include <Wire.h>
+#include <Arduino.h>
+
+VbI2CLinux::VbI2CLinux(VbI2C &server) : server(server)
+{
+    memset(&this->lastData, 0, sizeof(CLIENT_DATA));
+}
+
+bool VbI2CLinux::start(unsigned long interval)
+{
+    if (this->running.exchange(true))
+    {
+        return false;
+    }
+    this->interval = interval;
+    this->thread = std::thread(&VbI2CLinux::run, this);
+    return true;
+}
+
+void VbI2CLinux::stop()
+{
+    if (!this->running.exchange(false))
+    {
+        return;
+    }
+    this->thread.join();
+}
+
+bool VbI2CLinux::sendData(SERVER_DATA_T data)
+{
+    return this->outgoing.push(*data);
+}
+
+bool VbI2CLinux::hasData()
+{
+    return !this->incoming.empty();
+}
+
+CLIENT_DATA_T VbI2CLinux::getData()
+{
+    if (!this->incoming.pop(this->lastData))
+    {
+        return NULL;
+    }
+    return &this->lastData;
+}
+
+bool VbI2CLinux::call(uint8_t clientId, uint8_t method, const uint8_t *args, uint8_t length, RpcCallback callback, uint16_t timeout, void *context)
+{
+    // Vérifié ici: une requête invalide resterait sinon bloquée dans la file
+    if (clientId == 255 || length > RPC_ARGS_SIZE)
+    {
+        return false;
+    }
+
+    LINUX_RPC_CALL request;
+    request.clientId = clientId;
+    request.method = method;
+    memcpy(request.args, args, length);
+    request.length = length;
+    request.callback = callback;
+    request.timeout = timeout;
+    request.context = context;
+    return this->calls.push(request);
+}
+
+unsigned long VbI2CLinux::getDroppedPackets()
+{
+    return this->droppedPackets.load();
+}
+
+bool VbI2CLinux::getLatency(LINUX_LATENCY_SNAPSHOT_T snapshot)
+{
+    // Une copie arrivée après l'abandon d'une demande précédente serait périmée
+    while (this->latencySnapshots.pop(*snapshot))
+    {
+    }
+
+    this->latencyRequested.store(true);
+    unsigned long start = millis();
+    while (!this->latencySnapshots.pop(*snapshot))
+    {
+        if (!this->running.load() || millis() - start > 2 * this->interval + 100)
+        {
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+void VbI2CLinux::copyLatency(LINUX_LATENCY_SNAPSHOT_T snapshot)
+{
+    memset(snapshot, 0, sizeof(LINUX_LATENCY_SNAPSHOT));
+    // Les clients enregistrés sont ceux qui ont un histogramme
+    for (int clientId = 0; clientId < 128 && snapshot->clientCount < 8; clientId++)
+    {
+        LATENCY_HISTOGRAM_T histogram = this->server.getClientLatency(clientId);
+        if (histogram != NULL)
+        {
+            snapshot->clientIds[snapshot->clientCount] = clientId;
+            snapshot->clients[snapshot->clientCount++] = *histogram;
+        }
+    }
+    for (uint8_t dataType = 0; dataType < LATENCY_TYPE_COUNT; dataType++)
+    {
+        snapshot->types[dataType] = *this->server.getTypeLatency((CLIENT_DATA_TYPE)dataType);
+    }
+}
+
+void VbI2CLinux::run()
+{
+    while (this->running.load())
+    {
+        unsigned long start = millis();
+
+        // Les paquets de l'application rejoignent la file du serveur, dans la limite de sa taille.
+        // Celui qui ne rentre pas attend le prochain tick.
+        while (this->hasPendingPacket || this->outgoing.pop(this->pendingPacket))
+        {
+            this->hasPendingPacket = !this->server.sendData(&this->pendingPacket);
+            if (this->hasPendingPacket)
+            {
+                break;
+            }
+        }
+
+        // Pareil pour les requêtes RPC: celle que le serveur refuse (plus de place) attend le prochain tick
+        while (this->hasPendingCall || this->calls.pop(this->pendingCall))
+        {
+            LINUX_RPC_CALL *request = &this->pendingCall;
+            this->hasPendingCall = this->server.call(request->clientId, request->method, request->args, request->length, request->callback, request->timeout, request->context) == 0;
+            if (this->hasPendingCall)
+            {
+                break;
+            }
+        }
+
+        this->server.tick(); // Envoie lui-même ses derniers lots
+
+        while (this->server.hasData())
+        {
+            if (!this->incoming.push(*this->server.getData()))
+            {
+                this->droppedPackets++;
+            }
+        }
+
+        if (this->latencyRequested.exchange(false))
+        {
+            LINUX_LATENCY_SNAPSHOT snapshot;
+            this->copyLatency(&snapshot);
+            this->latencySnapshots.push(snapshot);
+        }
+
+        unsigned long elapsed = millis() - start;
+        if (elapsed < this->interval)
+        {
+            delay(this->interval - elapsed);
+        }
+    }
+}
@@ -0,0 +1,153 @@
+#ifndef VB_I2C_LINUX_HPP
+#define VB_I2C_LINUX_HPP
+
+#include <atomic>
+#include <thread>
+#include "../Server/VB_I2C.hpp"
+
+#define LINUX_CLIENT_QUEUE_SIZE 64 // Doit être une puissance de 2
+#define LINUX_SERVER_QUEUE_SIZE 64 // Doit être une puissance de 2
+#define LINUX_RPC_QUEUE_SIZE 16    // Doit être une puissance de 2
+
+// File à un producteur et un consommateur, sans verrou.
+template <typename T, unsigned int Size>
+class VbSpscQueue
+{
+    static_assert((Size & (Size - 1)) == 0, "VbSpscQueue: size must be a power of 2");
+
+public:
+    bool push(const T &item) // Thread producteur uniquement
+    {
+        unsigned int head = this->head.load(std::memory_order_relaxed);
+        if (head - this->tail.load(std::memory_order_acquire) >= Size)
+        {
+            return false;
+        }
+        this->items[head & (Size - 1)] = item;
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item) // Thread consommateur uniquement
+    {
+        unsigned int tail = this->tail.load(std::memory_order_relaxed);
+        if (tail == this->head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = this->items[tail & (Size - 1)];
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return this->tail.load(std::memory_order_acquire) == this->head.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[Size];
+    std::atomic<unsigned int> head{0};
+    std::atomic<unsigned int> tail{0};
+};
+
+typedef struct // Requête de l'application, en attente du thread du bus. Cf VbI2CLinux::call()
+{
+    uint8_t clientId;
+    uint8_t method;
+    uint8_t args[RPC_ARGS_SIZE];
+    uint8_t length;
+    RpcCallback callback;
+    uint16_t timeout;
+    void *context;
+} LINUX_RPC_CALL;
+
+typedef struct // Copie des histogrammes de latence du serveur, faite par le thread du bus. Cf VbI2CLinux::getLatency()
+{
+    uint8_t clientCount;
+    uint8_t clientIds[8];
+    LATENCY_HISTOGRAM clients[8]; // Même index que clientIds
+    LATENCY_HISTOGRAM types[LATENCY_TYPE_COUNT];
+} LINUX_LATENCY_SNAPSHOT, *LINUX_LATENCY_SNAPSHOT_T;
+
+// Fait tourner le serveur VbI2C sur un thread dédié, sous Linux (/dev/i2c-N).
+// Le thread appelle tick() à intervalle fixe. L'application échange les paquets avec lui par deux files sans verrou.
+class VbI2CLinux
+{
+public:
+    VbI2CLinux(VbI2C &); // Les clients doivent être enregistrés avec registerClient() avant start().
+    ~VbI2CLinux() { this->stop(); } // Un std::thread encore actif à sa destruction appellerait std::terminate()
+
+    bool start(unsigned long); // Lance le thread, un tick() toutes les n millisecondes.
+    void stop();
+
+    // Thread de l'application uniquement
+    bool sendData(SERVER_DATA_T); // Le paquet sera mis en file par le thread avant son prochain tick()
+    bool hasData();
+    CLIENT_DATA_T getData(); // Pointeur valable jusqu'au prochain appel. Même ordre que VbI2C::getData()
+
+    // Comme VbI2C::call(), mais la requête passe par une file: le thread la transmet au serveur avant son prochain tick().
+    // Le callback est appelé depuis le thread du bus, avec l'ID de corrélation choisi par le serveur et le contexte donné ici,
+    // qui sert à l'application pour retrouver sa requête. Renvoi false si les arguments sont invalides ou si la file est pleine.
+    bool call(uint8_t, uint8_t, const uint8_t *, uint8_t, RpcCallback, uint16_t, void * = NULL);
+
+    unsigned long getDroppedPackets(); // Paquets reçus perdus car la file vers l'application était pleine
+
+    // Copie des histogrammes de latence (VbI2C::getClientLatency() etc.), faite par le thread après son prochain tick().
+    // Attend cette copie, au plus deux intervalles. Renvoi false si le thread ne tourne pas ou n'a pas répondu.
+    bool getLatency(LINUX_LATENCY_SNAPSHOT_T);
+
+private:
+    VbI2C &server;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+    unsigned long interval = 0;
+
+    VbSpscQueue<SERVER_DATA, LINUX_SERVER_QUEUE_SIZE> outgoing; // Application -> thread
+    VbSpscQueue<CLIENT_DATA, LINUX_CLIENT_QUEUE_SIZE> incoming; // Thread -> application
+    VbSpscQueue<LINUX_RPC_CALL, LINUX_RPC_QUEUE_SIZE> calls;    // Application -> thread
+    std::atomic<unsigned long> droppedPackets{0};
+
+    std::atomic<bool> latencyRequested{false};
+    VbSpscQueue<LINUX_LATENCY_SNAPSHOT, 2> latencySnapshots; // Thread -> application
+
+    CLIENT_DATA lastData;
+
+    SERVER_DATA pendingPacket; // Paquet sorti de la file mais refusé par le serveur (file pleine)
+    bool hasPendingPacket = false;
+
+    LINUX_RPC_CALL pendingCall; // Requête sortie de la file mais refusée par le serveur (plus de place)
+    bool hasPendingCall = false;
+
+    void run();
+    void copyLatency(LINUX_LATENCY_SNAPSHOT_T); // Thread du bus uniquement
+};
+
+#endif
+
+/*
+Serveur sous Linux (Raspberry Pi etc.)
+
+Le code du serveur (Server/VB_I2C.cpp) est compilé tel quel: Arduino.h et Wire.h de ce dossier remplacent ceux d'Arduino.
+
+    g++ -std=c++11 -I Linux Server/VB_I2C.cpp Linux/Arduino.cpp Linux/Wire.cpp Linux/VB_I2C_LINUX.cpp main.cpp -lpthread
+
+    Wire.open("/dev/i2c-1");
+    VbI2C vb;
+    vb.registerClient(0x10);
+    VbI2CLinux runner(vb);
+    runner.start(50);
+
+Wire.h regroupe les transactions d'un client dans un seul ioctl(I2C_RDWR). A chaque tick(), pour chaque client:
+    - ses paquets en file et la demande d'informations: [W... R]
+    - s'il a des paquets: START_TX, les n lectures et STOP_TX: [W R... W]
+Le callback de VbI2C (setCallback) et ceux des requêtes RPC sont appelés depuis le thread du bus.
+Une fois le thread lancé, l'application passe par VbI2CLinux (sendData(), call(), getLatency()...). Les méthodes de VbI2C ne doivent plus être
+appelées que depuis ces callbacks.
+
+Sans matériel:
+    - Wire.setTransport() remplace l'ioctl par un simulateur de bus (Il reçoit exactement les lots qu'aurait reçu le noyau).
+      VB_I2C_BATCH_CHECK.cpp s'en sert pour vérifier la forme des lots.
+    - modprobe i2c-stub chip_addr=0x10 puis Wire.open(device, true): le stub ne fait que du SMBus, Wire.h passe alors par des transferts "I2C block".
+*/
@@ -0,0 +1,315 @@
+#include "Wire.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+TwoWire Wire;
+
+bool TwoWire::open(const char *device, bool smbusTestMode)
+{
+    this->close();
+
+    this->fd = ::open(device, O_RDWR);
+    if (this->fd < 0)
+    {
+        this->lastError = errno;
+        fprintf(stderr, "VbI2C: cannot open %s: %s\n", device, strerror(errno));
+        return false;
+    }
+
+    unsigned long functionalities = 0;
+    if (ioctl(this->fd, I2C_FUNCS, &functionalities) < 0)
+    {
+        this->lastError = errno;
+        fprintf(stderr, "VbI2C: I2C_FUNCS failed on %s: %s\n", device, strerror(errno));
+        this->close();
+        return false;
+    }
+
+    // i2c-stub n'émule que le SMBus: dans ce cas chaque message devient un transfert SMBus "I2C block".
+    // Le stub se comporte alors comme une mémoire de registres, ce qui suffit pour tester le maître sans matériel.
+    // Sur un vrai client, ces transferts ajoutent des écritures parasites: il faut le demander explicitement.
+    this->smbusOnly = !(functionalities & I2C_FUNC_I2C);
+    if (this->smbusOnly && !smbusTestMode)
+    {
+        fprintf(stderr, "VbI2C: %s does not support I2C_RDWR (SMBus only). Use open(device, true) for i2c-stub tests\n", device);
+        this->close();
+        return false;
+    }
+    if (this->smbusOnly && (functionalities & I2C_FUNC_SMBUS_I2C_BLOCK) != I2C_FUNC_SMBUS_I2C_BLOCK)
+    {
+        fprintf(stderr, "VbI2C: %s supports neither I2C_RDWR nor SMBus I2C block transfers\n", device);
+        this->close();
+        return false;
+    }
+    return true;
+}
+
+void TwoWire::close()
+{
+    if (this->fd >= 0)
+    {
+        ::close(this->fd);
+    }
+    this->fd = -1;
+    this->batchCount = 0;
+}
+
+void TwoWire::setTransport(WireTransport transport)
+{
+    this->transport = transport;
+}
+
+void TwoWire::begin()
+{
+    this->batchCount = 0;
+    this->rxLength = 0;
+    this->rxIndex = 0;
+}
+
+void TwoWire::begin(int)
+{
+    fprintf(stderr, "VbI2C: slave mode is not supported on Linux\n");
+}
+
+void TwoWire::beginTransmission(uint8_t address)
+{
+    this->txAddress = address;
+    this->txLength = 0;
+}
+
+size_t TwoWire::write(uint8_t data)
+{
+    if (this->txLength >= WIRE_BUFFER_SIZE)
+    {
+        return 0;
+    }
+    this->txBuffer[this->txLength++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t quantity)
+{
+    for (size_t i = 0; i < quantity; i++)
+    {
+        if (!this->write(data[i]))
+        {
+            return i;
+        }
+    }
+    return quantity;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop)
+{
+    if (this->fd < 0 && this->transport == NULL)
+    {
+        return 4;
+    }
+
+    // Un lot ne contient que des messages vers une seule adresse. On garde toujours une place pour la lecture.
+    if (this->batchCount > 0 && (this->batch[0].addr != this->txAddress || this->batchCount >= WIRE_BATCH_SIZE - 1))
+    {
+        this->flush();
+    }
+
+    memcpy(this->batchBuffer[this->batchCount], this->txBuffer, this->txLength);
+    struct i2c_msg *message = &this->batch[this->batchCount++];
+    message->addr = this->txAddress;
+    message->flags = 0;
+    message->len = this->txLength;
+    message->buf = this->batchBuffer[this->batchCount - 1];
+
+    if (!sendStop)
+    {
+        return 0;
+    }
+    return this->flush();
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity)
+{
+    if (quantity > WIRE_BUFFER_SIZE)
+    {
+        quantity = WIRE_BUFFER_SIZE;
+    }
+    this->rxLength = 0;
+    this->rxIndex = 0;
+
+    // Les écritures en attente pour un autre client partent seules
+    if (this->batchCount > 0 && this->batch[0].addr != address)
+    {
+        this->flush();
+    }
+
+    struct i2c_msg *message = &this->batch[this->batchCount];
+    message->addr = address;
+    message->flags = I2C_M_RD;
+    message->len = quantity;
+    message->buf = this->rxBuffer;
+
+    int count = this->batchCount + 1;
+    this->batchCount = 0;
+    if (this->transfer(count) != 0)
+    {
+        return 0;
+    }
+
+    this->rxLength = quantity;
+    return quantity;
+}
+
+void TwoWire::requestInto(uint8_t address, uint8_t *buffer, uint8_t quantity)
+{
+    if (quantity > WIRE_BUFFER_SIZE)
+    {
+        quantity = WIRE_BUFFER_SIZE;
+    }
+
+    // Mêmes règles que les écritures: une seule adresse par lot, une place gardée pour la lecture de requestFrom()
+    if (this->batchCount > 0 && (this->batch[0].addr != address || this->batchCount >= WIRE_BATCH_SIZE - 1))
+    {
+        this->flush();
+    }
+
+    struct i2c_msg *message = &this->batch[this->batchCount++];
+    message->addr = address;
+    message->flags = I2C_M_RD;
+    message->len = quantity;
+    message->buf = buffer;
+}
+
+int TwoWire::available()
+{
+    return this->rxLength - this->rxIndex;
+}
+
+int TwoWire::read()
+{
+    if (this->rxIndex >= this->rxLength)
+    {
+        return -1;
+    }
+    return this->rxBuffer[this->rxIndex++];
+}
+
+size_t TwoWire::readBytes(uint8_t *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length && this->rxIndex < this->rxLength)
+    {
+        buffer[count++] = this->rxBuffer[this->rxIndex++];
+    }
+    return count;
+}
+
+uint8_t TwoWire::flush()
+{
+    int count = this->batchCount;
+    this->batchCount = 0;
+    if (count == 0)
+    {
+        return 0;
+    }
+    return this->transfer(count);
+}
+
+int TwoWire::getLastError()
+{
+    return this->lastError;
+}
+
+uint8_t TwoWire::getLastResult()
+{
+    return this->lastResult;
+}
+
+uint8_t TwoWire::transfer(int count)
+{
+    int result;
+    if (this->transport != NULL)
+    {
+        result = this->transport(this->batch, count);
+    }
+    else if (this->fd < 0)
+    {
+        result = -EBADF;
+    }
+    else if (this->smbusOnly)
+    {
+        result = count;
+        for (int i = 0; i < count; i++)
+        {
+            if (!this->transferSmbus(&this->batch[i]))
+            {
+                result = -errno;
+                break;
+            }
+        }
+    }
+    else
+    {
+        struct i2c_rdwr_ioctl_data data;
+        data.msgs = this->batch;
+        data.nmsgs = count;
+        result = ioctl(this->fd, I2C_RDWR, &data);
+        if (result < 0)
+        {
+            result = -errno;
+        }
+    }
+
+    if (result < 0)
+    {
+        this->lastError = -result;
+        // Codes de Wire.endTransmission(): ENXIO / EREMOTEIO signalent un NACK sur l'adresse
+        this->lastResult = (this->lastError == ENXIO || this->lastError == EREMOTEIO) ? 2 : 4;
+        return this->lastResult;
+    }
+    this->lastError = 0;
+    this->lastResult = 0;
+    return 0;
+}
+
+bool TwoWire::transferSmbus(struct i2c_msg *message)
+{
+    if (ioctl(this->fd, I2C_SLAVE, message->addr) < 0)
+    {
+        return false;
+    }
+
+    union i2c_smbus_data data;
+    struct i2c_smbus_ioctl_data request;
+    request.data = &data;
+
+    if (message->flags & I2C_M_RD)
+    {
+        // Lecture à partir du registre 0
+        request.read_write = I2C_SMBUS_READ;
+        request.command = 0;
+        request.size = I2C_SMBUS_I2C_BLOCK_DATA;
+        data.block[0] = message->len;
+        if (ioctl(this->fd, I2C_SMBUS, &request) < 0)
+        {
+            return false;
+        }
+        memcpy(message->buf, &data.block[1], message->len);
+        return true;
+    }
+
+    if (message->len == 0)
+    {
+        return true;
+    }
+
+    // Le premier byte (le type de paquet) sert de registre, le reste est écrit à la suite
+    request.read_write = I2C_SMBUS_WRITE;
+    request.command = message->buf[0];
+    request.size = I2C_SMBUS_I2C_BLOCK_DATA;
+    data.block[0] = message->len - 1;
+    memcpy(&data.block[1], &message->buf[1], message->len - 1);
+    return ioctl(this->fd, I2C_SMBUS, &request) >= 0;
+}
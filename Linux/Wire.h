@@ -0,0 +1,94 @@
+#ifndef VB_I2C_LINUX_WIRE_H
+#define VB_I2C_LINUX_WIRE_H
+
+// Remplace la librairie Wire pour piloter le bus en maître depuis /dev/i2c-N. Cf VB_I2C_LINUX.hpp
+//
+// Comme sur Arduino, endTransmission(false) garde le bus pour la transaction suivante (pas de STOP).
+// Ici l'écriture est alors mise en attente et envoyée avec la lecture suivante au même client (requestFrom)
+// en un seul ioctl(I2C_RDWR). Une séquence écriture puis lecture de tick() ne coûte donc qu'un appel système.
+// requestInto() met aussi des lectures en attente: START_TX, les n lectures et STOP_TX partent ensemble.
+// Les autres écritures partent tout de suite et endTransmission() renvoi le vrai résultat.
+// Les lots ne mélangent jamais deux adresses: un client absent (NACK) ne fait pas perdre le trafic des autres.
+//
+// WIRE_BATCHED signale ce comportement au code commun (Server/VB_I2C.cpp): le résultat d'une écriture sans STOP n'est connu qu'à l'envoi du lot.
+#define WIRE_BATCHED
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define WIRE_BUFFER_SIZE 32
+#define WIRE_BATCH_SIZE I2C_RDWR_IOCTL_MAX_MSGS // Nombre maximum de messages par ioctl
+
+// Transfert d'une série de messages. Renvoi le nombre de messages transférés, ou une valeur négative en cas d'erreur.
+// Par défaut ioctl(I2C_RDWR) sur le fichier ouvert. Un simulateur de bus peut s'y substituer avec setTransport().
+typedef int (*WireTransport)(struct i2c_msg *messages, int count);
+
+class TwoWire
+{
+public:
+    // Ouvre l'adaptateur, par exemple "/dev/i2c-1". Renvoi false en cas d'erreur.
+    // smbusTestMode: accepte un adaptateur qui ne fait que du SMBus. Réservé à i2c-stub: chaque lecture "I2C block"
+    // commence par écrire le registre 0x00, qu'un vrai client VbI2C recevrait comme un paquet INIT.
+    bool open(const char *, bool smbusTestMode = false);
+    void close();
+
+    void setTransport(WireTransport);
+
+    void begin();    // Maître. Le bus doit déjà être ouvert avec open() ou setTransport().
+    void begin(int); // Esclave: pas supporté sous Linux.
+
+    void beginTransmission(uint8_t);
+    void beginTransmission(int address) { this->beginTransmission((uint8_t)address); }
+    size_t write(uint8_t);
+    size_t write(const uint8_t *, size_t);
+    // Renvoi 0 si tout s'est bien passé, 2 si le client n'a pas répondu (NACK), 4 pour les autres erreurs.
+    // sendStop == false: le message est mis en attente pour la lecture suivante, renvoi 0. Son erreur éventuelle est celle de requestFrom().
+    uint8_t endTransmission(bool sendStop = true);
+
+    // Envoi les écritures en attente pour ce client puis lit quantity bytes, dans le même ioctl. Renvoi le nombre de bytes lus (0 en cas d'erreur).
+    uint8_t requestFrom(uint8_t, uint8_t);
+    uint8_t requestFrom(int address, int quantity) { return this->requestFrom((uint8_t)address, (uint8_t)quantity); }
+
+    // Propre à Linux (WIRE_BATCHED): lecture mise dans le lot en attente. Les bytes arrivent dans le buffer à l'envoi du lot
+    // (endTransmission() avec STOP, flush()), si le transfert réussit. Le buffer doit rester valable jusque là.
+    void requestInto(uint8_t, uint8_t *, uint8_t);
+
+    int available();
+    int read();
+    size_t readBytes(uint8_t *, size_t);
+    size_t readBytes(char *buffer, size_t length) { return this->readBytes((uint8_t *)buffer, length); }
+
+    uint8_t flush(); // Envoi les écritures en attente. Même code de retour que endTransmission().
+
+    int getLastError();     // errno du dernier transfert raté, 0 sinon.
+    uint8_t getLastResult(); // Code du dernier transfert, comme endTransmission(). Sert à connaître le résultat d'un lot parti avec requestFrom().
+
+private:
+    int fd = -1;
+    bool smbusOnly = false; // L'adaptateur ne fait que du SMBus (i2c-stub par exemple)
+    WireTransport transport = NULL;
+    int lastError = 0;
+    uint8_t lastResult = 0;
+
+    uint8_t txAddress = 0;
+    uint8_t txBuffer[WIRE_BUFFER_SIZE];
+    uint8_t txLength = 0;
+
+    // Messages en attente. Le dernier emplacement est réservé à la lecture de requestFrom().
+    struct i2c_msg batch[WIRE_BATCH_SIZE];
+    uint8_t batchBuffer[WIRE_BATCH_SIZE][WIRE_BUFFER_SIZE];
+    int batchCount = 0;
+
+    uint8_t rxBuffer[WIRE_BUFFER_SIZE];
+    uint8_t rxLength = 0;
+    uint8_t rxIndex = 0;
+
+    uint8_t transfer(int count); // Même code de retour que endTransmission()
+    bool transferSmbus(struct i2c_msg *);
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,178 @@
+#ifndef VB_I2C_MESSAGE_SCHEMA
+#define VB_I2C_MESSAGE_SCHEMA
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "PACKET_TYPES.hpp"
+
+/*
+Déclaration typée des messages.
+
+On déclare une structure par type de paquet, puis la liste de ses champs une seule fois:
+
+    struct Progress
+    {
+        uint8_t step;
+        uint16_t total;
+    };
+    VB_SCHEMA(Progress, CLIENT_DATA_TYPE, PROGRESS, VB_FIELD(Progress, step), VB_FIELD(Progress, total));
+
+La taille encodée (ici 3 bytes) est calculée à la compilation et vérifiée contre la taille d'une trame.
+Ensuite:
+    vb.sendMessage(progress);                  // Client
+    vb.sendMessage(clientId, progress);        // Serveur
+    vb.dispatch(onProgress, onSuccess, ...);   // Appelle le handler correspondant au type du prochain paquet reçu
+                                               // Si aucun ne correspond, le paquet reste dans la file pour getData()
+
+Les champs sont encodés dans l'ordre de déclaration, sans padding, avec l'endianness de la machine (Comme le memcpy fait à la main).
+*/
+
+// Taille maximale des données d'un paquet, selon le sens de transmission (Cf SERVER_DATA / CLIENT_DATA)
+template <typename Type>
+struct VbPayloadLimit;
+
+template <>
+struct VbPayloadLimit<SERVER_DATA_TYPE>
+{
+    static const uint8_t value = 31;
+};
+
+template <>
+struct VbPayloadLimit<CLIENT_DATA_TYPE>
+{
+    static const uint8_t value = 30;
+};
+
+template <typename A, typename B>
+struct VbSameType
+{
+    static const bool value = false;
+};
+
+template <typename A>
+struct VbSameType<A, A>
+{
+    static const bool value = true;
+};
+
+// Un champ: un membre de la structure du message
+template <typename Message, typename Field, Field Message::*Member>
+struct VbField
+{
+    static const size_t size = sizeof(Field);
+
+    static void encode(const Message &message, uint8_t *out)
+    {
+        memcpy(out, &(message.*Member), size);
+    }
+
+    static void decode(const uint8_t *in, Message &message)
+    {
+        memcpy(&(message.*Member), in, size);
+    }
+};
+
+#define VB_FIELD(Message, member) VbField<Message, decltype(Message::member), &Message::member>
+
+// Liste de champs, encodés les uns à la suite des autres
+template <typename... Fields>
+struct VbFields;
+
+template <>
+struct VbFields<>
+{
+    static const size_t size = 0;
+
+    template <typename Message>
+    static void encode(const Message &, uint8_t *) {}
+
+    template <typename Message>
+    static void decode(const uint8_t *, Message &) {}
+};
+
+template <typename First, typename... Rest>
+struct VbFields<First, Rest...>
+{
+    static const size_t size = First::size + VbFields<Rest...>::size; // size_t: une somme trop grande ne doit pas déborder et passer le static_assert
+
+    template <typename Message>
+    static void encode(const Message &message, uint8_t *out)
+    {
+        First::encode(message, out);
+        VbFields<Rest...>::encode(message, out + First::size);
+    }
+
+    template <typename Message>
+    static void decode(const uint8_t *in, Message &message)
+    {
+        First::decode(in, message);
+        VbFields<Rest...>::decode(in + First::size, message);
+    }
+};
+
+template <typename Message, typename Type, Type Id, typename... Fields>
+struct VbSchema
+{
+    typedef Type DataType;
+    static const Type dataType = Id;
+    static const size_t size = VbFields<Fields...>::size; // Nombre de bytes de données réellement envoyés
+
+    static_assert(VbFields<Fields...>::size <= VbPayloadLimit<Type>::value, "VB_SCHEMA: message does not fit in one I2C frame");
+
+    static void encode(const Message &message, uint8_t *out)
+    {
+        VbFields<Fields...>::encode(message, out);
+    }
+
+    static void decode(const uint8_t *in, Message &message)
+    {
+        VbFields<Fields...>::decode(in, message);
+    }
+};
+
+// Spécialisé pour chaque message par VB_SCHEMA
+template <typename Message>
+struct VbSchemaOf;
+
+#define VB_SCHEMA(Message, Type, Id, ...) \
+    template <>                           \
+    struct VbSchemaOf<Message> : VbSchema<Message, Type, Type::Id, __VA_ARGS__> {}
+
+// Renvoi true si un des handlers correspond au type du paquet
+template <typename Packet>
+inline bool vbHandles(const Packet *)
+{
+    return false;
+}
+
+template <typename Packet, typename Message, typename... Handlers>
+inline bool vbHandles(const Packet *packet, void (*)(const Message &), Handlers... handlers)
+{
+    return packet->dataType == VbSchemaOf<Message>::dataType || vbHandles(packet, handlers...);
+}
+
+// Appelle le handler dont le message correspond au type du paquet. Renvoi false si aucun ne correspond.
+// Seuls les bytes déclarés sont lus, directement depuis le paquet.
+template <typename Packet>
+inline bool vbDispatch(const Packet *)
+{
+    return false;
+}
+
+template <typename Packet, typename Message, typename... Handlers>
+inline bool vbDispatch(const Packet *packet, void (*handler)(const Message &), Handlers... handlers)
+{
+    static_assert(VbSameType<decltype(packet->dataType), typename VbSchemaOf<Message>::DataType>::value, "vbDispatch: message is declared for the other direction");
+
+    if (packet->dataType == VbSchemaOf<Message>::dataType)
+    {
+        Message message;
+        VbSchemaOf<Message>::decode(packet->data, message);
+        handler(message);
+        return true;
+    }
+    return vbDispatch(packet, handlers...);
+}
+
+#endif
@@ -12,6 +12,10 @@ enum SERVER_DATA_TYPE : uint8_t
     STOP_TX = 0x3,   // Fin de la phase de transmission de donnée
 
     ABORT_GAME = 0x4,
+
+    TIME_SYNC = 0x5, // Horloge du serveur (uint32_t, micros()). Géré automatiquement, n'est pas transmis à l'utilisateur.
+
+    RPC_REQUEST = 0x6, // Requête envoyée par VbI2C::call(). data[0]: ID de corrélation, data[1]: méthode, puis RPC_ARGS_SIZE bytes d'arguments
 };
 
 enum CLIENT_DATA_TYPE : uint8_t
@@ -24,7 +28,28 @@ enum CLIENT_DATA_TYPE : uint8_t
 
     RUNTIME_ERROR = 0x3, // Une erreur est survenue. Par exemple une erreur de transmission avec un écran etc.
 
+    RPC_RESPONSE = 0x4, // Réponse à un RPC_REQUEST. data[0]: ID de corrélation, data[1]: RPC_STATUS, puis RPC_RESULT_SIZE bytes de résultat
+
     // ...
 };
 
-#endif
\ No newline at end of file
+// Horodatage des paquets client, activé type par type par le client (VbI2C::setTimestamping).
+// Un paquet horodaté a ce bit dans clientId, et l'heure synchronisée (uint32_t, micros() du serveur) dans data[26] à data[29].
+// Les autres paquets gardent leurs 30 bytes de données.
+#define CLIENT_TIMESTAMP_FLAG 0x80
+#define CLIENT_TIMESTAMP_OFFSET 26
+
+#define RPC_ARGS_SIZE 29   // Arguments d'une requête
+#define RPC_RESULT_SIZE 24 // Résultat d'une réponse. Laisse la place de l'horodatage.
+
+enum RPC_STATUS : uint8_t
+{
+    RPC_OK = 0x0,
+    RPC_UNKNOWN_METHOD = 0x1,
+    RPC_FAILED = 0x2,  // La méthode a échoué chez le client
+    RPC_TIMEOUT = 0x3, // Pas de réponse dans le délai. Défini par le serveur, jamais envoyé par un client.
+
+    // Les valeurs suivantes sont libres pour chaque énigme
+};
+
+#endif
@@ -24,7 +24,7 @@ VbI2C::VbI2C()
         Serial.print("Server PTR #");
         Serial.print(i);
         Serial.print(" -> 0x");
-        Serial.println((int)this->serverDataQueue[i], 16);
+        Serial.println((unsigned long)this->serverDataQueue[i], 16);
 #endif
         // On définie la mémoire à 0 pour avoir un espace de travail propre. (Evite les données parasites lors des transmissions)
         memset(this->serverDataQueue[i], 0, sizeof(SERVER_DATA));
@@ -48,11 +48,14 @@ VbI2C::VbI2C()
         Serial.print("Client PTR #");
         Serial.print(i);
         Serial.print(" -> 0x");
-        Serial.println((int)this->clientDataQueue[i], 16);
+        Serial.println((unsigned long)this->clientDataQueue[i], 16);
 #endif
         // On définie la mémoire à 0 pour avoir un espace de travail propre. (Evite les données parasites lors des transmissions)
         memset(this->clientDataQueue[i], 0, sizeof(CLIENT_DATA));
     }
+
+    this->clearLatency();
+    memset(this->rpcPending, 0, sizeof(this->rpcPending));
 }
 
 bool VbI2C::hasData()
@@ -66,26 +69,54 @@ CLIENT_DATA_T VbI2C::getData()
     return this->clientDataQueue[(this->clientDataAvailable--) - 1];
 }
 
-bool VbI2C::sendData(SERVER_DATA_T data)
+int VbI2C::acquireSlot(SERVER_DATA_TYPE dataType, uint8_t clientId)
 {
+    // Si le type est remplacé sur place, on cherche un paquet du même type et de même cible qui n'a pas encore été envoyé
+    // Les paquets en cours d'envoi par tick() ne sont plus remplacés: le nouveau partira au prochain tick()
+    if (dataType < 32 && (this->coalescedTypes >> dataType) & 1)
+    {
+        for (int i = this->serverDataSending; i < this->serverDataAvailable; i++)
+        {
+            if (this->serverDataQueue[i]->dataType == dataType && this->serverDataQueue[i]->clientId == clientId)
+            {
+#ifdef DEBUG
+                Serial.print("Coalescing data, index: ");
+                Serial.println(i);
+#endif
+                return i;
+            }
+        }
+    }
+
     int index = this->serverDataAvailable;
-    if (index > 15)
+    if (index >= SERVER_DATA_ARRAY_SIZE)
     {
-        return false;
+        return -1;
     }
 
 #ifdef DEBUG
     Serial.print("Sending data, index: ");
     Serial.print(index);
     Serial.print(" -> 0x");
-    Serial.println((int)this->serverDataQueue[index], 16);
+    Serial.println((unsigned long)this->serverDataQueue[index], 16);
 #endif
 
     this->serverDataAvailable++;
+    return index;
+}
+
+bool VbI2C::sendData(SERVER_DATA_T data)
+{
+    int index = this->acquireSlot(data->dataType, data->clientId);
+    if (index < 0)
+    {
+        return false;
+    }
 
     // On ajoute une donnée à la file.
     // J'utilise memcpy pour garder toujours les mêmes emplacements mémoires...
     memcpy(this->serverDataQueue[index], data, sizeof(SERVER_DATA));
+    this->serverDataLength[index] = 32;
 
 #ifdef DEBUG
     Serial.print("Packet ID: ");
@@ -94,11 +125,26 @@ bool VbI2C::sendData(SERVER_DATA_T data)
     return true;
 }
 
+void VbI2C::setCoalescing(SERVER_DATA_TYPE dataType, bool enabled)
+{
+    // Chaque requête RPC attend sa propre réponse: on ne les remplace jamais.
+    if (dataType >= 32 || dataType == SERVER_DATA_TYPE::RPC_REQUEST)
+    {
+        return;
+    }
+    if (enabled)
+    {
+        this->coalescedTypes |= ((uint32_t)1 << dataType);
+    }
+    else
+    {
+        this->coalescedTypes &= ~((uint32_t)1 << dataType);
+    }
+}
+
 bool VbI2C::fastSendData(SERVER_DATA_T data)
 {
-    Wire.beginTransmission(data->clientId);
-    Wire.write((uint8_t *)data, 32);
-    Wire.endTransmission();
+    return this->busWrite(data->clientId, (uint8_t *)data, 32) == 0;
 }
 
 void VbI2C::clearClientData()
@@ -119,12 +165,30 @@ void VbI2C::clearServerData()
         memset(this->serverDataQueue[i], 0, sizeof(SERVER_DATA));
     }
     this->serverDataAvailable = 0;
+    this->serverDataSending = 0; // Appelé depuis un callback pendant tick(): il n'y a plus rien à envoyer
 #ifdef DEBUG
     Serial.print("Cleared ServerData: ");
     Serial.println(this->serverDataAvailable);
 #endif
 }
 
+void VbI2C::removeServerData(int count)
+{
+    // On décale les paquets restants en tête de file. Les emplacements libérés passent à la fin, remis à 0.
+    for (int i = 0; i + count < this->serverDataAvailable; i++)
+    {
+        SERVER_DATA_T packet = this->serverDataQueue[i];
+        this->serverDataQueue[i] = this->serverDataQueue[i + count];
+        this->serverDataQueue[i + count] = packet;
+        this->serverDataLength[i] = this->serverDataLength[i + count];
+    }
+    this->serverDataAvailable -= count;
+    for (int i = this->serverDataAvailable; i < this->serverDataAvailable + count; i++)
+    {
+        memset(this->serverDataQueue[i], 0, sizeof(SERVER_DATA));
+    }
+}
+
 void VbI2C::receiveEvent()
 {
 
@@ -134,77 +198,400 @@ void VbI2C::receiveEvent()
 #ifdef DEBUG
         Serial.println("RECEIVED DATA FROM WIRE (Wire.available() == true)");
 #endif
+        if (this->clientDataAvailable >= CLIENT_DATA_ARRAY_SIZE)
+        {
+            // File pleine: le paquet est perdu
+            while (Wire.available())
+            {
+                Wire.read();
+            }
+            return;
+        }
+
         // On transfère les bytes reçues dans un emplacement mémoire. On caste en uint8_t (Au final, ce sont des uint8_t)
-        Wire.readBytes((uint8_t *)this->clientDataQueue[this->clientDataAvailable++], 32);
+        uint8_t *packet = (uint8_t *)this->clientDataQueue[this->clientDataAvailable++];
+        uint8_t received = Wire.readBytes(packet, 32);
+
+        // Paquet poussé par le client: enregistré comme une lecture (client -> serveur), à l'adresse de l'émetteur
+        this->capture(packet[offsetof(CLIENT_DATA, clientId)] & ~CLIENT_TIMESTAMP_FLAG, CAPTURE_READ, packet, received, received < 32 ? 1 : 0);
+        this->handleClientPacket();
+    }
+    else
+    {
 #ifdef DEBUG
-        Serial.print("IDX: ");
-        Serial.println(this->clientDataAvailable);
+        Serial.println("/!\\ NO DATA FROM WIRE (Wire.available() == false)");
 #endif
-        // On récupère le pointeur pour vérifier les données
-        CLIENT_DATA_T receivedData = this->clientDataQueue[this->clientDataAvailable - 1];
+    }
+}
 
-        if (receivedData->dataType == CLIENT_DATA_TYPE::START_ACK)
-        {
+void VbI2C::pollClient(uint8_t clientId)
+{
+    // File pleine: le client garde ses paquets jusqu'au prochain tick
+    if (this->clientDataAvailable >= CLIENT_DATA_ARRAY_SIZE)
+    {
+        return;
+    }
+
+    if (this->busRead(clientId, (uint8_t *)this->clientDataQueue[this->clientDataAvailable], 32) < 32)
+    {
 #ifdef DEBUG
-            Serial.println(">> START ACK RECEIVED <<");
+        Serial.println("/!\\ NO DATA FROM WIRE (Wire.available() == false)");
 #endif
-            // On traite le paquet
-            uint8_t packetsAvailable = 0;
-            memcpy(&packetsAvailable, &receivedData->data[0], sizeof(uint8_t));
+        return;
+    }
+    this->clientDataAvailable++;
+    this->handleClientPacket();
+}
+
+void VbI2C::handleClientPacket()
+{
 #ifdef DEBUG
-            Serial.print(packetsAvailable);
-            Serial.print(" packets available");
-            Serial.print(" from ");
-            Serial.println(receivedData->clientId, DEC);
+    Serial.print("IDX: ");
+    Serial.println(this->clientDataAvailable);
 #endif
-            SERVER_DATA_T startPacket = new SERVER_DATA();
-            startPacket->dataType = SERVER_DATA_TYPE::START_TX;
-            memset(startPacket->data, 0, 31);
-            startPacket->clientId = receivedData->clientId;
-            this->fastSendData(startPacket);
-            free(startPacket);
-
-            // Et pour chaque paquet, on le demande à l'émetteur
-            for (uint8_t packet = 0; packet < packetsAvailable; packet++)
-            {
-                Wire.requestFrom((int)receivedData->clientId, 32);
-                this->receiveEvent();
-            }
+    // On récupère le pointeur pour vérifier les données
+    CLIENT_DATA_T receivedData = this->clientDataQueue[this->clientDataAvailable - 1];
 
-            // END OF TX PACKET
-            SERVER_DATA_T endPacket = new SERVER_DATA();
-            endPacket->dataType = SERVER_DATA_TYPE::STOP_TX;
-            memset(endPacket->data, 0, 31);
-            endPacket->clientId = receivedData->clientId;
-            this->fastSendData(startPacket);
-            free(endPacket);
+    if (receivedData->dataType == CLIENT_DATA_TYPE::START_ACK)
+    {
+#ifdef DEBUG
+        Serial.println(">> START ACK RECEIVED <<");
+#endif
+        // On traite le paquet
+        uint8_t packetsAvailable = 0;
+        memcpy(&packetsAvailable, &receivedData->data[0], sizeof(uint8_t));
+#ifdef DEBUG
+        Serial.print(packetsAvailable);
+        Serial.print(" packets available");
+        Serial.print(" from ");
+        Serial.println(receivedData->clientId, DEC);
+#endif
+        // Le START_ACK n'est pas destiné à l'utilisateur: on libère sa place avant de recevoir les paquets.
+        uint8_t clientId = receivedData->clientId;
+        this->clientDataAvailable--;
 
-            this->clientDataAvailable--;
+        // Ceux qui ne rentrent pas dans la file restent chez le client jusqu'au prochain tick. Rien à lire: pas de START_TX / STOP_TX.
+        uint8_t count = packetsAvailable;
+        if (count > CLIENT_DATA_ARRAY_SIZE - this->clientDataAvailable)
+        {
+            count = CLIENT_DATA_ARRAY_SIZE - this->clientDataAvailable;
         }
-        else
+        if (count == 0)
         {
-#ifdef DEBUG
-            Serial.println(">> OTHER PACKET RECEIVED <<");
-            for (size_t i = 0; i < 32; i++)
+            return;
+        }
+
+        SERVER_DATA startPacket;
+        startPacket.dataType = SERVER_DATA_TYPE::START_TX;
+        memset(startPacket.data, 0, 31);
+        startPacket.clientId = clientId;
+
+        // END OF TX PACKET
+        SERVER_DATA endPacket;
+        endPacket.dataType = SERVER_DATA_TYPE::STOP_TX;
+        memset(endPacket.data, 0, 31);
+        endPacket.clientId = clientId;
+
+        // Les paquets arrivent dans la file à la suite, puis sont traités dans l'ordre de réception
+        int first = this->clientDataAvailable;
+        uint8_t received = this->busReadPackets(clientId, (uint8_t *)&startPacket, (uint8_t *)&endPacket, count);
+        for (uint8_t i = 0; i < received; i++)
+        {
+            // Les réponses RPC déjà traitées ont libéré leur place: on ramène le paquet juste après le dernier gardé
+            int index = first + i;
+            if (index != this->clientDataAvailable)
             {
-                Serial.print(((uint8_t *)receivedData)[i], HEX);
-                Serial.print(' ');
+                CLIENT_DATA_T packet = this->clientDataQueue[index];
+                this->clientDataQueue[index] = this->clientDataQueue[this->clientDataAvailable];
+                this->clientDataQueue[this->clientDataAvailable] = packet;
             }
-            Serial.println();
-#endif
 
-            if (this->hasCallback)
+            // Un START_ACK ici: le client n'a pas reçu le START_TX. On ne relance pas une séquence depuis celle-ci.
+            if (this->clientDataQueue[this->clientDataAvailable]->dataType == CLIENT_DATA_TYPE::START_ACK)
             {
-                this->userDataReceivedCallback();
+                continue;
             }
+            this->clientDataAvailable++;
+            this->handleClientPacket();
         }
     }
     else
     {
+        // Paquet horodaté par le client: on retire le marqueur pour l'utilisateur et on mesure la latence.
+        // En rejeu, les horodatages viennent de la capture: ils ne correspondent pas à l'horloge actuelle
+        if (receivedData->clientId & CLIENT_TIMESTAMP_FLAG)
+        {
+            receivedData->clientId &= ~CLIENT_TIMESTAMP_FLAG;
+            if (this->replaySource == NULL)
+            {
+                this->recordLatency(receivedData);
+            }
+        }
+
+        // Les réponses RPC vont directement au callback de la requête
+        if (receivedData->dataType == CLIENT_DATA_TYPE::RPC_RESPONSE)
+        {
+            this->handleRpcResponse(receivedData);
+            this->clientDataAvailable--;
+            return;
+        }
+
 #ifdef DEBUG
-        Serial.println("/!\\ NO DATA FROM WIRE (Wire.available() == false)");
+        Serial.println(">> OTHER PACKET RECEIVED <<");
+        for (size_t i = 0; i < 32; i++)
+        {
+            Serial.print(((uint8_t *)receivedData)[i], HEX);
+            Serial.print(' ');
+        }
+        Serial.println();
+#endif
+
+        if (this->hasCallback)
+        {
+            this->userDataReceivedCallback();
+        }
+    }
+}
+
+uint8_t VbI2C::busWrite(uint8_t address, const uint8_t *data, uint8_t length, bool sendStop)
+{
+    if (this->replaySource != NULL)
+    {
+        // Rejeu: rien ne part sur le bus, on compare avec la capture.
+        CAPTURE_RECORD_T record = this->replayPeek();
+        if (record == NULL)
+        {
+            return 4;
+        }
+        if (record->direction != CAPTURE_WRITE || record->address != address)
+        {
+            // Ecriture absente de la capture: on ne consomme rien, la suite reste synchronisée
+            this->replayResult.mismatches++;
+            return 0;
+        }
+
+        // L'heure d'un TIME_SYNC dépend du moment du rejeu, on l'ignore.
+        uint8_t compared = (length > 0 && data[0] == SERVER_DATA_TYPE::TIME_SYNC) ? 1 : length;
+        if (record->length != length || memcmp(record->data, data, compared) != 0)
+        {
+            this->replayResult.mismatches++;
+        }
+        uint8_t result = record->result;
+        this->replayConsume();
+        return result;
+    }
+
+    Wire.beginTransmission(address);
+    Wire.write(data, length);
+    uint8_t result = Wire.endTransmission(sendStop);
+#ifdef WIRE_BATCHED
+    if (!sendStop)
+    {
+        // Rien n'est encore parti: l'écriture est enregistrée à l'envoi du lot, avec le vrai résultat
+        this->deferCapture(address, CAPTURE_WRITE, data, length);
+        return result;
+    }
+    this->captureDeferred(result);
+#endif
+    this->capture(address, CAPTURE_WRITE, data, length, result);
+    return result;
+}
+
+uint8_t VbI2C::busRead(uint8_t address, uint8_t *data, uint8_t length)
+{
+    if (this->replaySource != NULL)
+    {
+        // Rejeu: les bytes viennent de la capture. Les écritures enregistrées sont des sorties du serveur:
+        // celles que ce serveur n'a pas refaites (sendData() de l'application pendant la capture...) sont sautées.
+        CAPTURE_RECORD_T record = this->replayPeek();
+        while (record != NULL && record->direction == CAPTURE_WRITE)
+        {
+            this->replayResult.skipped++;
+            this->replayConsume();
+            record = this->replayPeek();
+        }
+        if (record == NULL)
+        {
+            return 0;
+        }
+        if (record->address != address || record->length > length)
+        {
+            // La capture lit un autre client à ce moment: celui-ci n'a pas répondu
+            this->replayResult.mismatches++;
+            return 0;
+        }
+        uint8_t received = record->length;
+        memcpy(data, record->data, received);
+        this->replayConsume();
+        return received;
+    }
+
+    uint8_t received = Wire.requestFrom(address, length);
+    received = Wire.readBytes(data, received);
+#ifdef WIRE_BATCHED
+    this->captureDeferred(Wire.getLastResult()); // Les écritures en attente pour ce client sont parties avec la lecture
 #endif
+    this->capture(address, CAPTURE_READ, data, received, received < length ? 1 : 0);
+    return received;
+}
+
+uint8_t VbI2C::busReadPackets(uint8_t address, const uint8_t *startPacket, const uint8_t *endPacket, uint8_t count)
+{
+    // Les paquets sont écrits à la suite dans la file, à partir de clientDataAvailable
+    this->busWrite(address, startPacket, 32, false);
+#ifdef WIRE_BATCHED
+    if (this->replaySource == NULL)
+    {
+        // Les lectures rejoignent le lot du START_TX, et le STOP_TX l'envoie: toute la séquence tient en un seul transfert
+        for (uint8_t i = 0; i < count; i++)
+        {
+            uint8_t *packet = (uint8_t *)this->clientDataQueue[this->clientDataAvailable + i];
+            Wire.requestInto(address, packet, 32);
+            this->deferCapture(address, CAPTURE_READ, packet, 32);
+        }
+        return this->busWrite(address, endPacket, 32) == 0 ? count : 0;
     }
+#endif
+
+    uint8_t received = 0;
+    while (received < count && this->busRead(address, (uint8_t *)this->clientDataQueue[this->clientDataAvailable + received], 32) == 32)
+    {
+        received++;
+    }
+    this->busWrite(address, endPacket, 32);
+    return received;
+}
+
+void VbI2C::busFlush()
+{
+#ifdef WIRE_BATCHED
+    if (this->replaySource == NULL)
+    {
+        this->captureDeferred(Wire.flush());
+    }
+#endif
+}
+
+void VbI2C::capture(uint8_t address, uint8_t direction, const uint8_t *data, uint8_t length, uint8_t result)
+{
+    if (this->captureSink == NULL)
+    {
+        return;
+    }
+
+    CAPTURE_RECORD record;
+    record.timestamp = micros();
+    record.address = address;
+    record.direction = direction;
+    record.length = length;
+    record.result = result;
+    memcpy(record.data, data, length);
+    this->captureSink((uint8_t *)&record, CAPTURE_HEADER_SIZE + length);
+}
+
+#ifdef WIRE_BATCHED
+void VbI2C::deferCapture(uint8_t address, uint8_t direction, const uint8_t *data, uint8_t length)
+{
+    if (this->captureSink == NULL)
+    {
+        return;
+    }
+    if (this->captureDeferredCount >= CAPTURE_DEFERRED_SIZE)
+    {
+        // Ne devrait pas arriver: tick() envoie chaque lot avant d'en commencer un autre
+        this->capture(address, direction, data, length, 0);
+        return;
+    }
+    CAPTURE_DEFERRED *deferred = &this->captureDeferredQueue[this->captureDeferredCount++];
+    deferred->data = data;
+    deferred->address = address;
+    deferred->direction = direction;
+    deferred->length = length;
+}
+
+void VbI2C::captureDeferred(uint8_t result)
+{
+    for (uint8_t i = 0; i < this->captureDeferredCount; i++)
+    {
+        CAPTURE_DEFERRED *deferred = &this->captureDeferredQueue[i];
+        if (deferred->direction == CAPTURE_READ && result != 0)
+        {
+            // Lot raté: la lecture n'a rien reçu
+            this->capture(deferred->address, CAPTURE_READ, deferred->data, 0, 1);
+            continue;
+        }
+        this->capture(deferred->address, deferred->direction, deferred->data, deferred->length, result);
+    }
+    this->captureDeferredCount = 0;
+}
+#endif
+
+CAPTURE_RECORD_T VbI2C::replayPeek()
+{
+    if (!this->replayHasRecord)
+    {
+        if (this->replayDone || !this->replaySource(&this->replayRecord))
+        {
+            this->replayDone = true;
+            return NULL;
+        }
+        if (this->replayResult.records == 0)
+        {
+            this->replayFirstTimestamp = this->replayRecord.timestamp;
+        }
+        this->replayResult.records++;
+        this->replayHasRecord = true;
+    }
+    return &this->replayRecord;
+}
+
+void VbI2C::replayConsume()
+{
+    // Vitesse d'origine: on attend le moment de la transaction dans la capture
+    if (this->replayRealtime)
+    {
+        uint32_t target = this->replayRecord.timestamp - this->replayFirstTimestamp;
+        while ((uint32_t)(micros() - this->replayStart) < target)
+        {
+        }
+    }
+    this->replayHasRecord = false;
+    this->replayConsumed++;
+}
+
+void VbI2C::setCaptureSink(CaptureSink sink)
+{
+    this->captureSink = sink;
+    this->ticksUntilSync = 0; // Si la synchronisation est active, la capture commence par un TIME_SYNC: le rejeu retrouve la même séquence
+}
+
+REPLAY_RESULT VbI2C::replay(ReplaySource source, bool realtime)
+{
+    memset(&this->replayResult, 0, sizeof(REPLAY_RESULT));
+    this->replaySource = source;
+    this->replayRealtime = realtime;
+    this->replayDone = false;
+    this->replayHasRecord = false;
+    this->replayConsumed = 0;
+    this->replayStart = micros();
+    this->ticksUntilSync = 0;
+
+    // Chaque tick() consomme les transactions qu'il aurait faites sur le bus.
+    while (!this->replayDone)
+    {
+        uint32_t consumed = this->replayConsumed;
+        this->tick();
+        if (this->replayConsumed == consumed && this->replayPeek() != NULL)
+        {
+            // Rien de la capture ne correspond à ce que fait le serveur (client non enregistré...): on saute la transaction
+            this->replayResult.skipped++;
+            this->replayConsume();
+        }
+    }
+
+    this->replayResult.elapsed = micros() - this->replayStart;
+    this->replaySource = NULL;
+    return this->replayResult;
 }
 
 void VbI2C::setCallback(void (*user_func)())
@@ -259,13 +646,26 @@ void VbI2C::tick()
     Serial.println(" packets available");
 #endif
 
+    if (this->timeSyncInterval > 0)
+    {
+        if (this->ticksUntilSync == 0)
+        {
+            this->sendTimeSync();
+            this->ticksUntilSync = this->timeSyncInterval;
+        }
+        this->ticksUntilSync--;
+    }
+
+    // Les paquets mis en file pendant le tick() (par les callbacks) partiront au prochain
+    this->serverDataSending = this->serverDataAvailable;
+
     for (uint8_t clientIndex = 0; clientIndex < this->clientCount; clientIndex++)
     {
 
         uint8_t clientId = this->clients[clientIndex]; // On récupère l'ID I2C à partir du tableau des clients
 
         // Pour chaque paquet
-        for (uint8_t packetId = 0; packetId < this->serverDataAvailable; packetId++)
+        for (int packetId = 0; packetId < this->serverDataSending; packetId++)
         {
             // Si le paquet est destiné au client
             uint8_t target = this->serverDataQueue[packetId]->clientId;
@@ -278,35 +678,252 @@ void VbI2C::tick()
                 Serial.print(this->serverDataQueue[packetId]->dataType);
 #endif
 
-                Wire.beginTransmission(clientId);
-                // On envoie les données à la cible, moins l'ID de la cible.
-                Wire.write((uint8_t *)this->serverDataQueue[packetId], 32);
-                Wire.endTransmission();
+                // On envoie les données à la cible, moins l'ID de la cible. Pour un message VB_SCHEMA, seuls les bytes déclarés sont envoyés.
+                // Pas de STOP: les paquets du client et la demande d'informations qui suit partent ensemble (un seul transfert sous Linux).
+                this->busWrite(clientId, (uint8_t *)this->serverDataQueue[packetId], this->serverDataLength[packetId], false);
+                if (this->serverDataQueue[packetId]->dataType == SERVER_DATA_TYPE::RPC_REQUEST)
+                {
+                    this->startRpcDeadline(this->serverDataQueue[packetId]->data[0], clientId);
+                }
 #ifdef DEBUG
                 Serial.println(" SENT !");
 #endif
             }
         }
-    }
-    this->clearServerData();
 
-    // Ensuite, on requiert les données.
-    for (uint8_t clientIndex = 0; clientIndex < this->clientCount; clientIndex++)
-    {
-
-        uint8_t clientId = this->clients[clientIndex];
+        // Ensuite, on requiert les données.
 #ifdef DEBUG
         Serial.print("Client #");
         Serial.print(clientId);
         Serial.println(" sending packet request... ");
 #endif
+        this->pollClient(clientId);
 
-        Wire.requestFrom(clientId, (uint8_t)32);
-        this->receiveEvent();
+        // Rien ne doit rester en attente pour ce client (pollClient() n'a rien lu si la file est pleine)
+        this->busFlush();
     }
+    this->removeServerData(this->serverDataSending);
+    this->serverDataSending = 0;
+
+    // Les requêtes encore en attente d'envoi et absentes de la file en ont été retirées sans partir (client non enregistré, clearServerData()...): elles expirent à ce tick()
+    for (uint8_t i = 0; i < RPC_PENDING_SIZE; i++)
+    {
+        RPC_PENDING *pending = &this->rpcPending[i];
+        if (pending->correlationId == 0 || pending->sent)
+        {
+            continue;
+        }
+        bool stillQueued = false;
+        for (int packetId = 0; packetId < this->serverDataAvailable; packetId++)
+        {
+            SERVER_DATA_T packet = this->serverDataQueue[packetId];
+            stillQueued = stillQueued || (packet->dataType == SERVER_DATA_TYPE::RPC_REQUEST && packet->data[0] == pending->correlationId && packet->clientId == pending->clientId);
+        }
+        if (!stillQueued)
+        {
+            pending->sent = true;
+            pending->deadline = millis();
+        }
+    }
+
+    // Les réponses de ce tick() sont arrivées: les requêtes restantes peuvent expirer
+    this->expireRpcRequests();
 }
 
 void VbI2C::registerClient(int clientId)
 {
     this->clients[this->clientCount++] = clientId;
-}
\ No newline at end of file
+}
+
+void VbI2C::setTimeSyncInterval(uint8_t interval)
+{
+    this->timeSyncInterval = interval;
+    this->ticksUntilSync = 0;
+}
+
+void VbI2C::sendTimeSync()
+{
+    // Les écritures en attente (Linux: lot sans STOP) partent avant, pour ne pas être comptées dans la durée mesurée.
+    this->busFlush();
+
+    for (uint8_t clientIndex = 0; clientIndex < this->clientCount; clientIndex++)
+    {
+        // Paquet court: le type et l'heure, rien d'autre. L'heure est celle de la fin de transmission, estimée par la durée de la précédente.
+        // Il part avec un STOP: busWrite() ne revient qu'une fois le paquet transmis (Linux compris), la durée mesurée est donc la vraie.
+        uint8_t packet[1 + sizeof(uint32_t)];
+        packet[0] = SERVER_DATA_TYPE::TIME_SYNC;
+        uint32_t start = micros();
+        uint32_t serverTime = start + this->timeSyncDuration;
+        memcpy(&packet[1], &serverTime, sizeof(serverTime));
+        if (this->busWrite(this->clients[clientIndex], packet, sizeof(packet)) == 0)
+        {
+            this->timeSyncDuration = micros() - start;
+        }
+    }
+}
+
+void VbI2C::recordLatency(CLIENT_DATA_T packet)
+{
+    // Une erreur de synchronisation peut donner une latence négative: on la compte comme nulle
+    uint32_t timestamp;
+    memcpy(&timestamp, &packet->data[CLIENT_TIMESTAMP_OFFSET], sizeof(timestamp));
+    int32_t latency = (int32_t)(micros() - timestamp);
+    uint8_t bucket = 0;
+    for (int32_t limit = 1024; latency >= limit && bucket < LATENCY_BUCKETS - 1; limit <<= 1)
+    {
+        bucket++;
+    }
+
+    LATENCY_HISTOGRAM_T histograms[2] = {this->getClientLatency(packet->clientId), this->getTypeLatency(packet->dataType)};
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        if (histograms[i] != NULL && histograms[i]->buckets[bucket] < 0xFFFF)
+        {
+            histograms[i]->buckets[bucket]++;
+        }
+    }
+}
+
+LATENCY_HISTOGRAM_T VbI2C::getClientLatency(uint8_t clientId)
+{
+    for (uint8_t clientIndex = 0; clientIndex < this->clientCount; clientIndex++)
+    {
+        if (this->clients[clientIndex] == clientId)
+        {
+            return &this->clientLatency[clientIndex];
+        }
+    }
+    return NULL;
+}
+
+LATENCY_HISTOGRAM_T VbI2C::getTypeLatency(CLIENT_DATA_TYPE dataType)
+{
+    if (dataType >= LATENCY_TYPE_COUNT)
+    {
+        return NULL;
+    }
+    return &this->typeLatency[dataType];
+}
+
+void VbI2C::clearLatency()
+{
+    memset(this->clientLatency, 0, sizeof(this->clientLatency));
+    memset(this->typeLatency, 0, sizeof(this->typeLatency));
+}
+
+uint8_t VbI2C::call(uint8_t clientId, uint8_t method, const uint8_t *args, uint8_t length, RpcCallback callback, uint16_t timeout, void *context)
+{
+    if (clientId == 255 || length > RPC_ARGS_SIZE)
+    {
+        return 0;
+    }
+
+    RPC_PENDING *pending = NULL;
+    for (uint8_t i = 0; i < RPC_PENDING_SIZE; i++)
+    {
+        if (this->rpcPending[i].correlationId == 0)
+        {
+            pending = &this->rpcPending[i];
+            break;
+        }
+    }
+    if (pending == NULL)
+    {
+        return 0;
+    }
+
+    // Prochain ID libre, jamais 0
+    bool used = true;
+    while (used)
+    {
+        this->rpcLastId = this->rpcLastId == 255 ? 1 : this->rpcLastId + 1;
+        used = false;
+        for (uint8_t i = 0; i < RPC_PENDING_SIZE; i++)
+        {
+            used = used || this->rpcPending[i].correlationId == this->rpcLastId;
+        }
+    }
+
+    int index = this->acquireSlot(SERVER_DATA_TYPE::RPC_REQUEST, clientId);
+    if (index < 0)
+    {
+        return 0;
+    }
+
+    // Paquet court: seuls l'ID, la méthode et les arguments sont envoyés
+    SERVER_DATA_T packet = this->serverDataQueue[index];
+    packet->dataType = SERVER_DATA_TYPE::RPC_REQUEST;
+    packet->clientId = clientId;
+    packet->data[0] = this->rpcLastId;
+    packet->data[1] = method;
+    memcpy(&packet->data[2], args, length);
+    this->serverDataLength[index] = 3 + length;
+
+    pending->correlationId = this->rpcLastId;
+    pending->clientId = clientId;
+    pending->timeout = timeout;
+    pending->sent = false; // Le délai ne commence qu'à l'envoi, Cf startRpcDeadline()
+    pending->callback = callback;
+    pending->context = context;
+    return pending->correlationId;
+}
+
+bool VbI2C::handleRpcResponse(CLIENT_DATA_T response)
+{
+    for (uint8_t i = 0; i < RPC_PENDING_SIZE; i++)
+    {
+        RPC_PENDING *pending = &this->rpcPending[i];
+        if (pending->correlationId != 0 && pending->correlationId == response->data[0] && pending->clientId == response->clientId)
+        {
+            // On libère l'emplacement avant le callback, qui peut relancer une requête
+            RpcCallback callback = pending->callback;
+            void *context = pending->context;
+            pending->correlationId = 0;
+            if (callback != NULL)
+            {
+                callback(response->data[0], response->data[1], &response->data[2], context);
+            }
+            return true;
+        }
+    }
+
+#ifdef DEBUG
+    Serial.print("Unexpected RPC response #");
+    Serial.println(response->data[0]);
+#endif
+    return false;
+}
+
+void VbI2C::startRpcDeadline(uint8_t correlationId, uint8_t clientId)
+{
+    for (uint8_t i = 0; i < RPC_PENDING_SIZE; i++)
+    {
+        RPC_PENDING *pending = &this->rpcPending[i];
+        if (pending->correlationId == correlationId && pending->clientId == clientId && !pending->sent)
+        {
+            pending->sent = true;
+            pending->deadline = millis() + pending->timeout;
+            return;
+        }
+    }
+}
+
+void VbI2C::expireRpcRequests()
+{
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < RPC_PENDING_SIZE; i++)
+    {
+        RPC_PENDING *pending = &this->rpcPending[i];
+        if (pending->correlationId != 0 && pending->sent && (int32_t)(now - pending->deadline) >= 0)
+        {
+            uint8_t correlationId = pending->correlationId;
+            RpcCallback callback = pending->callback;
+            void *context = pending->context;
+            pending->correlationId = 0;
+            if (callback != NULL)
+            {
+                callback(correlationId, RPC_STATUS::RPC_TIMEOUT, NULL, context);
+            }
+        }
+    }
+}
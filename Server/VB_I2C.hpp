@@ -4,8 +4,17 @@
 #define CLIENT_DATA_ARRAY_SIZE 9
 #define SERVER_DATA_ARRAY_SIZE 8
 
+#define LATENCY_BUCKETS 12   // Bucket 0: moins de 1ms, bucket i: de 2^(9+i) à 2^(10+i) µs. Le dernier compte tout au dessus de ~1s
+#define LATENCY_TYPE_COUNT 8 // Types de paquets client suivis (0 à 7)
+
+#define RPC_PENDING_SIZE 8 // Nombre de requêtes en attente de réponse, tous clients confondus
+
 #include <stdint.h>
+#include <stddef.h>
+#include <Wire.h>
 #include "../PACKET_TYPES.hpp"
+#include "../MESSAGE_SCHEMA.hpp"
+#include "../BUS_CAPTURE.hpp"
 
 
 typedef struct // Données envoyées par le serveur au client
@@ -19,9 +28,40 @@ typedef struct // Données envoyées par le client
 {
     enum CLIENT_DATA_TYPE dataType; // Type de paquet
     uint8_t clientId;               // Emetteur du message
-    uint8_t data[30];               // Données, 30 bytes
+    uint8_t data[30];               // Données, 30 bytes. Les 4 derniers portent l'horodatage si clientId & CLIENT_TIMESTAMP_FLAG
 } CLIENT_DATA, *CLIENT_DATA_T;
 
+typedef struct // Nombre de paquets par tranche de latence. Sature à 65535.
+{
+    uint16_t buckets[LATENCY_BUCKETS];
+} LATENCY_HISTOGRAM, *LATENCY_HISTOGRAM_T;
+
+// Appelé à la réponse ou à l'expiration d'une requête: (ID de corrélation, RPC_STATUS, résultat, contexte passé à call()). Résultat NULL si RPC_TIMEOUT.
+typedef void (*RpcCallback)(uint8_t, uint8_t, const uint8_t *, void *);
+
+#ifdef WIRE_BATCHED
+#define CAPTURE_DEFERRED_SIZE (SERVER_DATA_ARRAY_SIZE + CLIENT_DATA_ARRAY_SIZE + 1)
+
+typedef struct // Transaction mise dans un lot pas encore envoyé. Enregistrée à l'envoi du lot, Cf VbI2C::captureDeferred()
+{
+    const uint8_t *data; // Reste valable jusqu'à l'envoi du lot
+    uint8_t address;
+    uint8_t direction;
+    uint8_t length;
+} CAPTURE_DEFERRED;
+#endif
+
+typedef struct // Requête en attente de réponse
+{
+    uint8_t correlationId; // 0: emplacement libre
+    uint8_t clientId;
+    uint16_t timeout;  // ms, comptés à partir de l'écriture de la requête sur le bus
+    bool sent;         // La requête est partie: deadline est valable
+    uint32_t deadline; // millis()
+    RpcCallback callback;
+    void *context; // Rendu tel quel au callback
+} RPC_PENDING;
+
 class VbI2C
 {
 public:
@@ -32,7 +72,20 @@ public:
 
     // Ajoute des infos pour le prochain envoi
     bool sendData(SERVER_DATA_T);
+
+    // Pareil, pour un message déclaré avec VB_SCHEMA. Seuls les champs déclarés sont copiés, puis envoyés sur le bus.
+    template <typename Message>
+    bool sendMessage(uint8_t clientId, const Message &);
+
+    // Retire le prochain paquet de la file et appelle le handler typé correspondant. Cf MESSAGE_SCHEMA.hpp
+    // Renvoi false si la file est vide ou si aucun handler ne correspond: dans ce cas le paquet reste disponible pour getData().
+    template <typename... Handlers>
+    bool dispatch(Handlers...);
     
+    // Si activé pour un type, un nouveau paquet de ce type (et de même cible) remplace sur place celui encore en attente d'envoi au lieu d'être ajouté à la file.
+    // Utile pour les paquets d'état dont seule la dernière valeur compte. Types 0 à 31 uniquement.
+    void setCoalescing(SERVER_DATA_TYPE, bool);
+
     // Envoi instantanément des données
     bool fastSendData(SERVER_DATA_T);
 
@@ -45,6 +98,12 @@ public:
     // L'utilisateur peut définir un callback qui sera appelé à chaque fois que le serveur envoi un paquet.
     void setCallback(void (*)());
 
+    // Requête au client (méthode, arguments, taille <= RPC_ARGS_SIZE), envoyée au prochain tick().
+    // Le client répond dans le même tick(): le callback est appelé à la réception de la réponse, ou après le délai (ms) compté à partir de l'envoi.
+    // Plusieurs requêtes peuvent être en attente, y compris vers le même client. Renvoi l'ID de corrélation, 0 si plus de place.
+    // Le contexte (optionnel) est rendu au callback: il permet de retrouver la requête sans connaître l'ID.
+    uint8_t call(uint8_t, uint8_t, const uint8_t *, uint8_t, RpcCallback, uint16_t, void * = NULL);
+
     // Sert à envoyer les paquets. 
     void tick(); 
 
@@ -54,21 +113,121 @@ public:
      // Sert à vérifier le contenu de la mémoire
     void dump(); 
 
+    // Envoie l'horloge du serveur (TIME_SYNC) à chaque client tous les n tick(). 0 pour désactiver. Désactivé par défaut.
+    // A activer pour mesurer la latence (20 convient): tous les clients doivent alors connaître TIME_SYNC.
+    void setTimeSyncInterval(uint8_t);
+
+    // Latence de bout en bout: de sendData() chez le client jusqu'à l'appel du callback, en temps synchronisé.
+    // Seuls les types horodatés par le client comptent (Cf setTimestamping() côté client), et seulement avec setTimeSyncInterval().
+    LATENCY_HISTOGRAM_T getClientLatency(uint8_t);        // NULL si le client n'est pas enregistré
+    LATENCY_HISTOGRAM_T getTypeLatency(CLIENT_DATA_TYPE); // NULL si le type n'est pas suivi (>= LATENCY_TYPE_COUNT)
+    void clearLatency();
+
+    // Chaque transaction sur le bus est enregistrée et passée à la fonction. NULL pour arrêter. Cf BUS_CAPTURE.hpp
+    void setCaptureSink(CaptureSink);
+
+    // Rejoue une capture à la place du bus en appelant tick() jusqu'à la fin. realtime: vitesse d'origine, sinon au maximum.
+    REPLAY_RESULT replay(ReplaySource, bool);
+
 
 private:
     SERVER_DATA_T serverDataQueue[SERVER_DATA_ARRAY_SIZE]; // Array de pointeurs vers les données du serveur en attente d'être lues
     CLIENT_DATA_T clientDataQueue[CLIENT_DATA_ARRAY_SIZE]; // Array de pointeurs vers les données du client en attente d'être envoyées
+    uint8_t serverDataLength[SERVER_DATA_ARRAY_SIZE];      // Nombre de bytes à envoyer pour chaque paquet (Type + données)
 
     int clients[8];
 int clientCount = 0;
 
     int serverDataAvailable = 0; // Le nombre de paquets disponibles
+    int serverDataSending = 0;   // Pendant tick(): les premiers paquets de la file, en cours d'envoi
     int clientDataAvailable = 0; // Le nombre de paquets à envoyer
 
+    uint32_t coalescedTypes = 0; // Un bit par type de paquet remplacé sur place. Cf setCoalescing()
+
     bool hasCallback = false;
     void (*userDataReceivedCallback)();
 
-    
+    uint8_t timeSyncInterval = 0;
+    uint8_t ticksUntilSync = 0;     // 0: TIME_SYNC au prochain tick()
+    uint32_t timeSyncDuration = 0;  // Durée de la dernière transmission TIME_SYNC, ajoutée à l'heure envoyée
+
+    LATENCY_HISTOGRAM clientLatency[8]; // Même index que clients
+    LATENCY_HISTOGRAM typeLatency[LATENCY_TYPE_COUNT];
+
+    RPC_PENDING rpcPending[RPC_PENDING_SIZE];
+    uint8_t rpcLastId = 0;
+
+    CaptureSink captureSink = NULL;
+#ifdef WIRE_BATCHED
+    CAPTURE_DEFERRED captureDeferredQueue[CAPTURE_DEFERRED_SIZE];
+    uint8_t captureDeferredCount = 0;
+#endif
+
+    ReplaySource replaySource = NULL; // Non NULL pendant un rejeu: le bus n'est plus utilisé.
+    bool replayRealtime = false;
+    bool replayDone = false;
+    CAPTURE_RECORD replayRecord; // Prochaine transaction de la capture, valable si replayHasRecord
+    bool replayHasRecord = false;
+    uint32_t replayConsumed = 0;
+    uint32_t replayStart = 0;
+    uint32_t replayFirstTimestamp = 0;
+    REPLAY_RESULT replayResult;
+
+    int acquireSlot(SERVER_DATA_TYPE, uint8_t); // Index de l'emplacement où écrire le prochain paquet, -1 si la file est pleine.
+    void removeServerData(int);                 // Retire les n premiers paquets de la file
+
+    void pollClient(uint8_t);  // Demande un paquet au client
+    void handleClientPacket(); // Traite le dernier paquet reçu
+    void sendTimeSync();
+    void recordLatency(CLIENT_DATA_T);
+    bool handleRpcResponse(CLIENT_DATA_T); // Renvoi false si aucune requête n'attendait cette réponse
+    void startRpcDeadline(uint8_t, uint8_t); // La requête (ID de corrélation, client) vient d'être écrite sur le bus
+    void expireRpcRequests();
+
+    // Seuls points d'accès au bus. Cf BUS_CAPTURE.hpp
+    uint8_t busWrite(uint8_t, const uint8_t *, uint8_t, bool = true); // Renvoi le résultat de Wire.endTransmission(sendStop)
+    uint8_t busRead(uint8_t, uint8_t *, uint8_t);        // Renvoi le nombre de bytes lus
+    // START_TX, n paquets de 32 bytes lus dans la file (à partir de clientDataAvailable), STOP_TX. Renvoi le nombre de paquets reçus.
+    uint8_t busReadPackets(uint8_t, const uint8_t *, const uint8_t *, uint8_t);
+    void busFlush();                                     // Envoi les écritures encore en attente (Linux)
+    void capture(uint8_t, uint8_t, const uint8_t *, uint8_t, uint8_t);
+#ifdef WIRE_BATCHED
+    void deferCapture(uint8_t, uint8_t, const uint8_t *, uint8_t);
+    void captureDeferred(uint8_t); // Enregistre les transactions du lot qui vient de partir, avec son résultat
+#endif
+    CAPTURE_RECORD_T replayPeek(); // Prochaine transaction de la capture, sans la consommer. NULL à la fin.
+    void replayConsume();
 };
 
+template <typename Message>
+bool VbI2C::sendMessage(uint8_t clientId, const Message &message)
+{
+    typedef VbSchemaOf<Message> Schema;
+    static_assert(VbSameType<typename Schema::DataType, SERVER_DATA_TYPE>::value, "sendMessage: not a server message");
+
+    int index = this->acquireSlot(Schema::dataType, clientId);
+    if (index < 0)
+    {
+        return false;
+    }
+
+    SERVER_DATA_T packet = this->serverDataQueue[index];
+    packet->dataType = Schema::dataType;
+    packet->clientId = clientId;
+    Schema::encode(message, packet->data);
+    this->serverDataLength[index] = 1 + Schema::size;
+    return true;
+}
+
+template <typename... Handlers>
+bool VbI2C::dispatch(Handlers... handlers)
+{
+    // On ne retire le paquet que si un handler le prend
+    if (!this->hasData() || !vbHandles(this->clientDataQueue[this->clientDataAvailable - 1], handlers...))
+    {
+        return false;
+    }
+    return vbDispatch(this->getData(), handlers...);
+}
+
 #endif
\ No newline at end of file